@@ -0,0 +1,355 @@
+#include <config.h>
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <SDL.h>
+
+#ifdef HAVE_JANSSON
+#include <jansson.h>
+#endif
+
+#include "mapedit/canvas.h"
+#include "mapedit/geometry.h"
+#include "mapedit/mapfile.h"
+#include "mapedit/mapread.h"
+#include "mapedit/nodetree.h"
+#include "mapedit/util.h"
+
+/* times the editor's map loading as it was, with a jansson tree walked
+ * twice, arrays grown an id at a time and the node tree built insert by
+ * insert, against mapread and a bulk node tree build, on the same files.
+ * the vertex grid and the adjacency are built the same way by both, so
+ * they're left out.
+ *   loadbench [-r runs] map.json ...
+ * each time is the best of the runs.  the old loader only read json, and
+ * without libjansson only the new one is timed */
+
+#define MIN(a,b) ((a) < (b) ? (a) : (b))
+#define MAX(a,b) ((a) > (b) ? (a) : (b))
+
+/* a map in memory the way the canvas holds it, indexed by id */
+struct bench_map {
+    size_t verts_count, verts_alloc;
+    float *xs, *ys;
+    size_t nodes_count, nodes_alloc;
+    uint32_t *nodes;            /* MAPFILE_NONE first where there's none */
+};
+
+struct bench_times {
+    double parse, tree;
+};
+
+/* for the node tree's bounds callback */
+static const struct bench_map *bounds_map;
+
+static double seconds_since(Uint64 start)
+{
+    return (double) (SDL_GetPerformanceCounter() - start)
+         / SDL_GetPerformanceFrequency();
+}
+
+static void bench_map_free(struct bench_map *map)
+{
+    free(map->xs);
+    free(map->ys);
+    free(map->nodes);
+    memset(map, 0, sizeof *map);
+}
+
+static void node_bounds(node_id id, fpoint *tl, fpoint *br)
+{
+    const uint32_t *v = &bounds_map->nodes[3 * id];
+    const float *xs = bounds_map->xs, *ys = bounds_map->ys;
+
+    tl->x = MIN(xs[v[0]], MIN(xs[v[1]], xs[v[2]]));
+    tl->y = MIN(ys[v[0]], MIN(ys[v[1]], ys[v[2]]));
+    br->x = MAX(xs[v[0]], MAX(xs[v[1]], xs[v[2]]));
+    br->y = MAX(ys[v[0]], MAX(ys[v[1]], ys[v[2]]));
+}
+
+#ifdef HAVE_JANSSON
+/* as verts_ensure() and nodes_ensure() were: room for n more, doubling */
+static void old_verts_ensure(struct bench_map *map, size_t n)
+{
+    size_t i, old = map->verts_alloc;
+
+    if (map->verts_alloc >= map->verts_count + n)
+        return;
+
+    if (!map->verts_alloc)
+        map->verts_alloc = n;
+    while (map->verts_alloc < map->verts_count + n)
+        map->verts_alloc += map->verts_alloc;
+
+    map->xs = realloc(map->xs, map->verts_alloc * sizeof map->xs[0]);
+    map->ys = realloc(map->ys, map->verts_alloc * sizeof map->ys[0]);
+    assert(map->xs != NULL && map->ys != NULL);
+    for (i = old; i < map->verts_alloc; i++)
+        map->xs[i] = map->ys[i] = NAN;
+}
+
+static void old_nodes_ensure(struct bench_map *map, size_t n)
+{
+    size_t i, old = map->nodes_alloc;
+
+    if (map->nodes_alloc >= map->nodes_count + n)
+        return;
+
+    if (!map->nodes_alloc)
+        map->nodes_alloc = n;
+    while (map->nodes_alloc < map->nodes_count + n)
+        map->nodes_alloc += map->nodes_alloc;
+
+    map->nodes = realloc(map->nodes, map->nodes_alloc * 3 * sizeof map->nodes[0]);
+    assert(map->nodes != NULL);
+    for (i = 3 * old; i < 3 * map->nodes_alloc; i++)
+        map->nodes[i] = MAPFILE_NONE;
+}
+
+/* canvas_load before the rewrite, less the parts that haven't changed */
+static int old_load(const char *filename, struct bench_map *map, struct bench_times *t)
+{
+    json_t *jcanvas, *jverts, *jnodes, *jscale, *jvert, *jnode, *jnode_ids;
+    json_error_t error;
+    const char *key;
+    double scale, x, y;
+    Uint64 start;
+    size_t id;
+
+    memset(map, 0, sizeof *map);
+    start = SDL_GetPerformanceCounter();
+
+    jcanvas = json_load_file(filename, JSON_REJECT_DUPLICATES, &error);
+    if (!jcanvas) {
+        fprintf(stderr, "%s:%d: %s\n", filename, error.line, error.text);
+        return -1;
+    }
+
+    jscale = json_object_get(jcanvas, "scale");
+    scale = jscale ? 1.0 : 1.0 / MAPFILE_LEGACY_UNITPX;
+
+    jverts = json_object_get(jcanvas, "vertices");
+    if (jverts) {
+        json_object_foreach(jverts, key, jvert) {
+            id = strtoul(key, NULL, 10);
+            if (id >= map->verts_count)
+                old_verts_ensure(map, 1 + id - map->verts_count);
+            map->verts_count = MAX(map->verts_count, id + 1);
+        }
+    }
+
+    jnodes = json_object_get(jcanvas, "nodes");
+    if (jnodes) {
+        json_object_foreach(jnodes, key, jnode) {
+            uint32_t *v;
+            int a, b, c;
+
+            id = strtoul(key, NULL, 10);
+            if (id >= map->nodes_count)
+                old_nodes_ensure(map, 1 + id - map->nodes_count);
+            map->nodes_count = MAX(map->nodes_count, id + 1);
+
+            json_unpack(jnode, "{ s: [i, i, i !] !}", "v", &a, &b, &c);
+            v = &map->nodes[3 * id];
+            v[0] = a;
+            v[1] = b;
+            v[2] = c;
+        }
+    }
+
+    if (jverts) {
+        json_object_foreach(jverts, key, jvert) {
+            id = strtoul(key, NULL, 10);
+            jnode_ids = NULL;
+            json_unpack(jvert, "{ s: [F, F !], s: o !}",
+                        "p", &x, &y, "nodes", &jnode_ids);
+            map->xs[id] = x * scale;
+            map->ys[id] = y * scale;
+        }
+    }
+
+    json_decref(jcanvas);
+    t->parse = seconds_since(start);
+
+    start = SDL_GetPerformanceCounter();
+    nodetree_reset();
+    bounds_map = map;
+    for (id = 0; id < map->nodes_count; id++) {
+        fpoint tl, br;
+
+        if (map->nodes[3 * id] == MAPFILE_NONE) continue;
+        node_bounds(id, &tl, &br);
+        nodetree_insert(id, tl, br);
+    }
+    t->tree = seconds_since(start);
+
+    return 0;
+}
+
+/* how many vertices or nodes the two loaders read differently */
+static size_t bench_differ(const struct bench_map *a, const struct bench_map *b)
+{
+    size_t i, differ = 0;
+
+    if (a->verts_count != b->verts_count || a->nodes_count != b->nodes_count)
+        return (size_t) -1;
+
+    for (i = 0; i < a->verts_count; i++) {
+        if (memcmp(&a->xs[i], &b->xs[i], sizeof a->xs[i])
+            || memcmp(&a->ys[i], &b->ys[i], sizeof a->ys[i]))
+            differ ++;
+    }
+
+    for (i = 0; i < a->nodes_count; i++) {
+        if (memcmp(&a->nodes[3 * i], &b->nodes[3 * i], 3 * sizeof a->nodes[0]))
+            differ ++;
+    }
+
+    return differ;
+}
+#endif
+
+/* canvas_load as it is, less the same parts */
+static int new_load(const char *filename, struct bench_map *map, struct bench_times *t)
+{
+    struct mapread in;
+    node_id *ids;
+    Uint64 start;
+    size_t i, n = 0;
+
+    memset(map, 0, sizeof *map);
+    start = SDL_GetPerformanceCounter();
+
+    if (mapread_load(filename, &in) < 0)
+        return -1;
+
+    map->verts_count = map->verts_alloc = in.verts_count;
+    map->xs = malloc((in.verts_count + 1) * sizeof map->xs[0]);
+    map->ys = malloc((in.verts_count + 1) * sizeof map->ys[0]);
+    map->nodes_count = map->nodes_alloc = in.nodes_count;
+    map->nodes = malloc((in.nodes_count + 1) * 3 * sizeof map->nodes[0]);
+    assert(map->xs != NULL && map->ys != NULL && map->nodes != NULL);
+    memcpy(map->xs, in.xs, in.verts_count * sizeof map->xs[0]);
+    memcpy(map->ys, in.ys, in.verts_count * sizeof map->ys[0]);
+    memcpy(map->nodes, in.nodes, in.nodes_count * 3 * sizeof map->nodes[0]);
+
+    mapread_free(&in);
+    t->parse = seconds_since(start);
+
+    start = SDL_GetPerformanceCounter();
+    ids = malloc((map->nodes_count + 1) * sizeof ids[0]);
+    assert(ids != NULL);
+    for (i = 0; i < map->nodes_count; i++)
+        if (map->nodes[3 * i] != MAPFILE_NONE)
+            ids[n++] = i;
+
+    nodetree_reset();
+    bounds_map = map;
+    nodetree_build(ids, n, &node_bounds);
+    free(ids);
+    t->tree = seconds_since(start);
+
+    return 0;
+}
+
+static void best_of(struct bench_times *best, const struct bench_times *t)
+{
+    best->parse = MIN(best->parse, t->parse);
+    best->tree = MIN(best->tree, t->tree);
+}
+
+static int bench_file(const char *filename, unsigned runs)
+{
+    struct bench_map new_map;
+    struct bench_times t, new_best = { INFINITY, INFINITY };
+    size_t i, live = 0;
+    unsigned run;
+
+    for (run = 0; run < runs; run++) {
+        if (new_load(filename, &new_map, &t) < 0)
+            return -1;
+        best_of(&new_best, &t);
+        if (run + 1 < runs)
+            bench_map_free(&new_map);
+    }
+
+    for (i = 0; i < new_map.nodes_count; i++)
+        if (new_map.nodes[3 * i] != MAPFILE_NONE)
+            live ++;
+
+    printf("%s: %zu vertex ids, %zu nodes\n", filename, new_map.verts_count, live);
+    printf("  new: %8.1fms parsing, %8.1fms node tree, %8.1fms in all\n",
+           1000 * new_best.parse, 1000 * new_best.tree,
+           1000 * (new_best.parse + new_best.tree));
+
+#ifdef HAVE_JANSSON
+    if (!has_extension(filename, ".bin")) {
+        struct bench_map old_map;
+        struct bench_times old_best = { INFINITY, INFINITY };
+        size_t differ;
+
+        for (run = 0; run < runs; run++) {
+            if (old_load(filename, &old_map, &t) < 0) {
+                bench_map_free(&new_map);
+                return -1;
+            }
+            best_of(&old_best, &t);
+            if (run + 1 < runs)
+                bench_map_free(&old_map);
+        }
+
+        differ = bench_differ(&old_map, &new_map);
+        bench_map_free(&old_map);
+
+        printf("  old: %8.1fms parsing, %8.1fms node tree, %8.1fms in all\n",
+               1000 * old_best.parse, 1000 * old_best.tree,
+               1000 * (old_best.parse + old_best.tree));
+        printf("  new is %.1fx faster parsing, %.1fx building the tree, %.1fx in all\n",
+               old_best.parse / new_best.parse, old_best.tree / new_best.tree,
+               (old_best.parse + old_best.tree) / (new_best.parse + new_best.tree));
+
+        if (differ) {
+            fprintf(stderr, "loadbench: %s: old and new read %zu things differently\n",
+                    filename, differ);
+            bench_map_free(&new_map);
+            return -1;
+        }
+    }
+    else {
+        printf("  old: didn't read .bin\n");
+    }
+#else
+    printf("  old: needs libjansson\n");
+#endif
+
+    bench_map_free(&new_map);
+    nodetree_reset();
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned runs = 3;
+    int i, r = 0;
+
+    for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+        if (!strcmp(argv[i], "-r") && i + 1 < argc)
+            runs = strtoul(argv[++i], NULL, 10);
+        else
+            break;
+    }
+
+    if (i == argc || argv[i][0] == '-' || runs == 0) {
+        fprintf(stderr, "usage: %s [-r runs] map.json ...\n", argv[0]);
+        return 2;
+    }
+
+    for (; r == 0 && i < argc; i++)
+        r = bench_file(argv[i], runs);
+
+    return r < 0 ? 1 : 0;
+}
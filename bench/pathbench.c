@@ -0,0 +1,958 @@
+#include <config.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <SDL.h>
+
+#include "engine/batch.h"
+#include "engine/ch.h"
+#include "engine/flowfield.h"
+#include "engine/hpa.h"
+#include "engine/path.h"
+#include "engine/pathcache.h"
+#include "engine/trifile.h"
+#include "engine/trigraph.h"
+#include "mapc/bake.h"
+#include "mapc/read.h"
+
+/* times path queries between random pairs of nodes, with plain a* and
+ * then with each hierarchy (built in memory, rather than loaded), then
+ * through a path cache, then all at once as a batch on 1, 2, 4...
+ * threads.  crowds heading for one goal are timed with a* against a flow
+ * field, and before all that, finding the nodes under random points.
+ *   pathbench [-q queries] [-s seed] [-t threads] [map.tri ...]
+ * threads defaults to the number of cpus.  with no maps, it generates a
+ * few sizes of jittered grid with rectangular holes knocked out of them
+ */
+
+#define CORRIDOR_MAX (INDEX_NULL + 1)
+
+#define BATCH_SMALL         (64)        /* requests, in the miscount check */
+#define BATCH_SMALL_RUNS    (2000)
+
+static const unsigned generated_sizes[] = { 32, 90, 180 };
+
+static uint32_t rng_state;
+
+/* xorshift32, so runs with the same seed pick the same queries anywhere */
+static uint32_t rng(void)
+{
+    uint32_t x = rng_state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return rng_state = x;
+}
+
+static float rng_float(void)
+{
+    return (rng() >> 8) / 16777216.0f;
+}
+
+/* a size x size grid of cells, each split into two nodes along a random
+ * diagonal, with inner vertices nudged about and about a fifth of the
+ * cells knocked out in rectangles.  baked the same way as mapc would */
+static int generate(unsigned size, struct trigraph *graph)
+{
+    struct mapc_map map;
+    struct mapc_stats stats;
+    unsigned char *holes;
+    const unsigned row = size + 1;
+    unsigned x, y, knocked = 0;
+    int r;
+
+    memset(&map, 0, sizeof map);
+    map.verts_count = row * row;
+    map.xs = malloc(map.verts_count * sizeof map.xs[0]);
+    map.ys = malloc(map.verts_count * sizeof map.ys[0]);
+    map.nodes = malloc(2 * 3 * size * size * sizeof map.nodes[0]);
+    holes = calloc(size * size, 1);
+    if (!map.xs || !map.ys || !map.nodes || !holes) {
+        fprintf(stderr, "pathbench: out of memory\n");
+        r = -1;
+        goto out;
+    }
+
+    for (y = 0; y <= size; y++) {
+        for (x = 0; x <= size; x++) {
+            const int inner = x > 0 && x < size && y > 0 && y < size;
+
+            map.xs[y * row + x] = x + (inner ? (rng_float() - 0.5f) / 2 : 0);
+            map.ys[y * row + x] = y + (inner ? (rng_float() - 0.5f) / 2 : 0);
+        }
+    }
+
+    while (knocked < size * size / 5) {
+        const unsigned w = 1 + rng() % (size / 8 + 1), h = 1 + rng() % (size / 8 + 1);
+        const unsigned x0 = rng() % size, y0 = rng() % size;
+
+        for (y = y0; y < y0 + h && y < size; y++) {
+            for (x = x0; x < x0 + w && x < size; x++) {
+                if (!holes[y * size + x]) knocked ++;
+                holes[y * size + x] = 1;
+            }
+        }
+    }
+
+    for (y = 0; y < size; y++) {
+        for (x = 0; x < size; x++) {
+            const uint32_t a = y * row + x, b = a + 1, c = a + row, d = c + 1;
+            uint32_t *n = &map.nodes[3 * map.nodes_count];
+
+            if (holes[y * size + x]) continue;
+
+            if (rng() & 1) {
+                n[0] = a; n[1] = b; n[2] = d;
+                n[3] = a; n[4] = d; n[5] = c;
+            }
+            else {
+                n[0] = a; n[1] = b; n[2] = c;
+                n[3] = b; n[4] = d; n[5] = c;
+            }
+            map.nodes_count += 2;
+        }
+    }
+
+    r = mapc_bake(&map, graph, &stats);
+
+out:
+    free(map.xs);
+    free(map.ys);
+    free(map.nodes);
+    free(holes);
+    return r;
+}
+
+static double seconds_since(Uint64 start)
+{
+    return (double) (SDL_GetPerformanceCounter() - start)
+         / SDL_GetPerformanceFrequency();
+}
+
+static int length_cmp(const void *a, const void *b)
+{
+    const size_t x = *(const size_t *) a, y = *(const size_t *) b;
+
+    return (x > y) - (x < y);
+}
+
+static int over_cmp(const void *a, const void *b)
+{
+    const double x = *(const double *) a, y = *(const double *) b;
+
+    return (x > y) - (x < y);
+}
+
+/* the same random queries, put to each way of answering them in turn */
+struct bench {
+    const char *name;
+    const struct trigraph *graph;
+    unsigned queries;
+    uint16_t *pairs;
+    size_t *lengths;            /* of a*'s corridors, 0 where unreachable */
+    float *costs;               /* a*'s */
+    double *times;              /* a*'s */
+    size_t long_len;            /* the longest quarter of corridors */
+    uint16_t *corridor;
+    struct vertex *waypoints;
+};
+
+static int bench_init(struct bench *bench, const char *name,
+                      const struct trigraph *graph, unsigned queries)
+{
+    unsigned i;
+
+    memset(bench, 0, sizeof *bench);
+    bench->name = name;
+    bench->graph = graph;
+    bench->queries = queries;
+
+    bench->pairs = malloc(2 * queries * sizeof bench->pairs[0]);
+    bench->lengths = malloc(queries * sizeof bench->lengths[0]);
+    bench->costs = malloc(queries * sizeof bench->costs[0]);
+    bench->times = malloc(queries * sizeof bench->times[0]);
+    bench->corridor = malloc(CORRIDOR_MAX * sizeof bench->corridor[0]);
+    bench->waypoints = malloc((CORRIDOR_MAX + 1) * sizeof bench->waypoints[0]);
+    if (!bench->pairs || !bench->lengths || !bench->costs || !bench->times
+        || !bench->corridor || !bench->waypoints) {
+        fprintf(stderr, "pathbench: out of memory\n");
+        return -1;
+    }
+
+    for (i = 0; i < 2 * queries; i++)
+        bench->pairs[i] = rng() % graph->nodes_count;
+
+    return 0;
+}
+
+static void bench_fini(struct bench *bench)
+{
+    free(bench->pairs);
+    free(bench->lengths);
+    free(bench->costs);
+    free(bench->times);
+    free(bench->corridor);
+    free(bench->waypoints);
+}
+
+static void bench_astar(struct bench *bench)
+{
+    const struct trigraph *graph = bench->graph;
+    struct path_scratch *scratch;
+    size_t *sorted, expanded = 0, length = 0, unreachable = 0, turns = 0;
+    double elapsed = 0, funnel_elapsed = 0, total_cost = 0;
+    const unsigned queries = bench->queries;
+    Uint64 start;
+    unsigned i;
+
+    scratch = path_scratch_new(graph);
+
+    for (i = 0; i < queries; i++) {
+        size_t len;
+
+        start = SDL_GetPerformanceCounter();
+        len = path_find(graph, scratch, bench->pairs[2 * i], bench->pairs[2 * i + 1],
+                        bench->corridor, CORRIDOR_MAX, &bench->costs[i]);
+        bench->times[i] = seconds_since(start);
+        bench->lengths[i] = len;
+        elapsed += bench->times[i];
+
+        expanded += scratch->expanded;
+        if (len) {
+            length += len;
+            total_cost += bench->costs[i];
+
+            /* string pulling between the two centroids, timed on its own */
+            start = SDL_GetPerformanceCounter();
+            turns += path_funnel(graph, bench->corridor, len,
+                                 scratch->centroids[bench->corridor[0]],
+                                 scratch->centroids[bench->corridor[len - 1]],
+                                 bench->waypoints, CORRIDOR_MAX + 1);
+            funnel_elapsed += seconds_since(start);
+        }
+        else {
+            unreachable ++;
+        }
+    }
+
+    sorted = malloc(queries * sizeof sorted[0]);
+    if (sorted) {
+        memcpy(sorted, bench->lengths, queries * sizeof sorted[0]);
+        qsort(sorted, queries, sizeof sorted[0], &length_cmp);
+        bench->long_len = sorted[queries - 1 - queries / 4];
+        free(sorted);
+    }
+
+    printf("%s: %zu nodes, a* %u queries in %.3fs, %.0f queries/s, "
+           "%.0f expanded and %.0f in the corridor on average, "
+           "%zu unreachable, mean cost %.2f\n",
+           bench->name, graph->nodes_count, queries, elapsed,
+           elapsed > 0 ? queries / elapsed : 0.0,
+           (double) expanded / queries,
+           queries > unreachable ? (double) length / (queries - unreachable) : 0.0,
+           unreachable,
+           queries > unreachable ? total_cost / (queries - unreachable) : 0.0);
+    if (queries > unreachable)
+        printf("%s: funnel %.2fus per corridor, %.1f waypoints on average\n",
+               bench->name, 1e6 * funnel_elapsed / (queries - unreachable),
+               (double) turns / (queries - unreachable));
+
+    path_scratch_free(scratch);
+}
+
+/* against a*, over all the queries and over the long ones */
+static void bench_hpa(struct bench *bench)
+{
+    const struct trigraph *graph = bench->graph;
+    struct hpa_scratch *scratch;
+    struct hpa hpa;
+    size_t expanded = 0, found = 0, missed = 0;
+    double elapsed = 0, long_elapsed = 0, astar = 0, astar_long = 0;
+    double worse = 0, *overs;
+    Uint64 start;
+    unsigned i;
+
+    /* how much dearer each path found was, to sort for the percentiles */
+    overs = malloc((bench->queries + 1) * sizeof overs[0]);
+    if (!overs) {
+        fprintf(stderr, "pathbench: out of memory\n");
+        return;
+    }
+
+    start = SDL_GetPerformanceCounter();
+    if (hpa_build(graph, HPA_CLUSTER_NODES, &hpa) < 0) {
+        free(overs);
+        return;
+    }
+    printf("%s: hpa built in %.1fms, %zu clusters, %zu entrances, %zu edges\n",
+           bench->name, 1000 * seconds_since(start),
+           hpa.clusters_count, hpa.abstract_count, hpa.edges_count);
+
+    scratch = hpa_scratch_new(graph, &hpa);
+
+    for (i = 0; i < bench->queries; i++) {
+        double t;
+        size_t len;
+        float cost;
+
+        start = SDL_GetPerformanceCounter();
+        len = hpa_find(graph, &hpa, scratch, bench->pairs[2 * i], bench->pairs[2 * i + 1],
+                       bench->corridor, CORRIDOR_MAX, &cost);
+        t = seconds_since(start);
+
+        elapsed += t;
+        astar += bench->times[i];
+        if (bench->lengths[i] >= bench->long_len) {
+            long_elapsed += t;
+            astar_long += bench->times[i];
+        }
+        expanded += scratch->expanded;
+
+        if (!len != !bench->lengths[i]) {
+            missed ++;
+        }
+        else if (len && bench->costs[i] > 0) {
+            const double over = cost / bench->costs[i] - 1;
+
+            worse += over;
+            overs[found++] = over;
+        }
+    }
+
+    qsort(overs, found, sizeof overs[0], &over_cmp);
+    printf("%s: hpa %.0f queries/s, %.0f expanded on average, %.1fx a*; "
+           "%.1fx a* on the longest quarter (%zu+ nodes); "
+           "paths cost %.1f%% more on average, %.1f%% at the 99th percentile, "
+           "%.1f%% at worst",
+           bench->name, elapsed > 0 ? bench->queries / elapsed : 0.0,
+           (double) expanded / bench->queries,
+           elapsed > 0 ? astar / elapsed : 0.0,
+           long_elapsed > 0 ? astar_long / long_elapsed : 0.0, bench->long_len,
+           found ? 100 * worse / found : 0.0,
+           found ? 100 * overs[found - 1 - found / 100] : 0.0,
+           found ? 100 * overs[found - 1] : 0.0);
+    if (missed)
+        printf("; %zu disagree with a* about reachability", missed);
+    printf("\n");
+
+    hpa_scratch_free(scratch);
+    hpa_free(&hpa);
+    free(overs);
+}
+
+/* against a*, which it should match exactly but for rounding */
+static void bench_ch(struct bench *bench)
+{
+    const struct trigraph *graph = bench->graph;
+    struct ch_scratch *scratch;
+    struct ch ch;
+    size_t expanded = 0, missed = 0;
+    double elapsed = 0, long_elapsed = 0, astar = 0, astar_long = 0, off = 0;
+    Uint64 start;
+    unsigned i;
+
+    start = SDL_GetPerformanceCounter();
+    ch_build(graph, &ch);
+    printf("%s: ch built in %.1fms, %zu shortcuts, %zu up and %zu down edges\n",
+           bench->name, 1000 * seconds_since(start),
+           ch.shortcuts_count, ch.up_count, ch.down_count);
+
+    scratch = ch_scratch_new(&ch);
+
+    for (i = 0; i < bench->queries; i++) {
+        double t;
+        size_t len;
+        float cost;
+
+        start = SDL_GetPerformanceCounter();
+        len = ch_find(graph, &ch, scratch, bench->pairs[2 * i], bench->pairs[2 * i + 1],
+                      bench->corridor, CORRIDOR_MAX, &cost);
+        t = seconds_since(start);
+
+        elapsed += t;
+        astar += bench->times[i];
+        if (bench->lengths[i] >= bench->long_len) {
+            long_elapsed += t;
+            astar_long += bench->times[i];
+        }
+        expanded += scratch->expanded;
+
+        if (!len != !bench->lengths[i]) {
+            missed ++;
+        }
+        else if (len && bench->costs[i] > 0) {
+            const double d = fabs(cost / bench->costs[i] - 1);
+
+            if (d > off) off = d;
+        }
+    }
+
+    printf("%s: ch %.0f queries/s, %.0f expanded on average, %.1fx a*; "
+           "%.1fx a* on the longest quarter (%zu+ nodes); "
+           "costs within %.1e of a*'s",
+           bench->name, elapsed > 0 ? bench->queries / elapsed : 0.0,
+           (double) expanded / bench->queries,
+           elapsed > 0 ? astar / elapsed : 0.0,
+           long_elapsed > 0 ? astar_long / long_elapsed : 0.0, bench->long_len, off);
+    if (missed)
+        printf("; %zu disagree with a* about reachability", missed);
+    printf("\n");
+
+    ch_scratch_free(scratch);
+    ch_free(&ch);
+}
+
+/* random points over the map's bounds and a bit past them, found with
+ * the grid and by testing every node, which should agree.  those off the
+ * mesh are then moved onto it both ways, which should agree on distance.
+ * the points come from their own rng, so the maps generated after this
+ * one are the same with it as without */
+static void bench_locate(struct bench *bench)
+{
+    const struct trigraph *graph = bench->graph;
+    const struct trigrid *grid = &graph->grid;
+    struct trigraph linear;
+    struct vertex *points;
+    uint16_t *found;
+    float min_x, min_y, max_x, max_y;
+    double grid_elapsed = 0, linear_elapsed = 0, nearest_elapsed = 0, far = 0;
+    size_t off = 0, wrong = 0;
+    const uint32_t saved = rng_state;
+    Uint64 start;
+    unsigned i;
+
+    if (grid->columns == 0) {
+        printf("%s: no grid\n", bench->name);
+        return;
+    }
+
+    points = malloc(bench->queries * sizeof points[0]);
+    found = malloc(bench->queries * sizeof found[0]);
+    if (!points || !found) {
+        fprintf(stderr, "pathbench: out of memory\n");
+        goto out;
+    }
+
+    min_x = max_x = graph->vertices[0].x;
+    min_y = max_y = graph->vertices[0].y;
+    for (i = 1; i < graph->vertices_count; i++) {
+        const struct vertex *v = &graph->vertices[i];
+
+        if (v->x < min_x) min_x = v->x;
+        if (v->y < min_y) min_y = v->y;
+        if (v->x > max_x) max_x = v->x;
+        if (v->y > max_y) max_y = v->y;
+    }
+
+    rng_state = bench->queries;
+    for (i = 0; i < bench->queries; i++) {
+        points[i].x = min_x + (max_x - min_x) * (1.2f * rng_float() - 0.1f);
+        points[i].y = min_y + (max_y - min_y) * (1.2f * rng_float() - 0.1f);
+    }
+    rng_state = saved;
+
+    linear = *graph;
+    linear.grid.columns = 0;
+
+    start = SDL_GetPerformanceCounter();
+    for (i = 0; i < bench->queries; i++)
+        found[i] = trigraph_locate(graph, points[i].x, points[i].y);
+    grid_elapsed = seconds_since(start);
+
+    for (i = 0; i < bench->queries; i++) {
+        uint16_t id;
+
+        start = SDL_GetPerformanceCounter();
+        id = trigraph_locate(&linear, points[i].x, points[i].y);
+        linear_elapsed += seconds_since(start);
+
+        if (id != found[i]) wrong ++;
+    }
+
+    for (i = 0; i < bench->queries; i++) {
+        struct vertex a, b;
+        double da, db;
+
+        if (found[i] != INDEX_NULL) continue;
+        off ++;
+
+        start = SDL_GetPerformanceCounter();
+        trigraph_nearest(graph, points[i].x, points[i].y, &a);
+        nearest_elapsed += seconds_since(start);
+
+        trigraph_nearest(&linear, points[i].x, points[i].y, &b);
+        da = hypot(a.x - points[i].x, a.y - points[i].y);
+        db = hypot(b.x - points[i].x, b.y - points[i].y);
+        if (fabs(da - db) > 1e-4 * (1 + db)) wrong ++;
+        far += da;
+    }
+
+    printf("%s: %ux%u grid, %.1f nodes a cell; locate %.2fus with it, %.2fus without; "
+           "%zu off the mesh, nearest %.2fus, %.2f away on average",
+           bench->name, grid->columns, grid->rows,
+           (double) grid->entries_count / ((double) grid->columns * grid->rows),
+           1e6 * grid_elapsed / bench->queries, 1e6 * linear_elapsed / bench->queries,
+           off, off ? 1e6 * nearest_elapsed / off : 0.0, off ? far / off : 0.0);
+    if (wrong)
+        printf("; %zu disagree with testing every node", wrong);
+    printf("\n");
+
+out:
+    free(points);
+    free(found);
+}
+
+/* agents from a few spawn points heading for a few objectives, so the
+ * same routes come up again and again, with a cost raised somewhere every
+ * so often.  run once with a* alone and once through a cache too small
+ * for every route; costs only go up, so what the cache hands back should
+ * cost just what a* finds.  on copies of the nodes, with their own rng,
+ * so nothing after sees any of it */
+#define CACHE_SPAWNS        (64)
+#define CACHE_OBJECTIVES    (8)
+#define CACHE_ENTRIES       (256)
+#define CACHE_CHANGE_EVERY  (50)
+
+static void bench_cache(struct bench *bench)
+{
+    const unsigned queries = bench->queries;
+    const size_t nodes_size = bench->graph->nodes_count * sizeof bench->graph->nodes[0];
+    struct trigraph graph = *bench->graph;
+    struct path_scratch *scratch;
+    struct pathcache *cache = NULL;
+    struct pathcache_stats stats;
+    uint16_t *pairs, *changes;
+    float *costs;
+    double plain = 0, cached = 0;
+    size_t wrong = 0;
+    const uint32_t saved = rng_state;
+    unsigned i, run, changed = 0;
+    Uint64 start;
+
+    pairs = malloc(2 * queries * sizeof pairs[0]);
+    changes = malloc(2 * (queries / CACHE_CHANGE_EVERY + 1) * sizeof changes[0]);
+    costs = malloc(queries * sizeof costs[0]);
+    graph.nodes = malloc(nodes_size);
+    if (!pairs || !changes || !costs || !graph.nodes) {
+        fprintf(stderr, "pathbench: out of memory\n");
+        goto out;
+    }
+
+    rng_state = 2 * queries + 1;
+    {
+        uint16_t spawns[CACHE_SPAWNS], objectives[CACHE_OBJECTIVES];
+
+        for (i = 0; i < CACHE_SPAWNS; i++)
+            spawns[i] = rng() % graph.nodes_count;
+        for (i = 0; i < CACHE_OBJECTIVES; i++)
+            objectives[i] = rng() % graph.nodes_count;
+        for (i = 0; i < queries; i++) {
+            pairs[2 * i] = spawns[rng() % CACHE_SPAWNS];
+            pairs[2 * i + 1] = objectives[rng() % CACHE_OBJECTIVES];
+        }
+        for (i = 0; i < queries / CACHE_CHANGE_EVERY + 1; i++) {
+            changes[2 * i] = rng() % graph.nodes_count;
+            changes[2 * i + 1] = rng() % 3;
+        }
+    }
+    rng_state = saved;
+
+    memcpy(graph.nodes, bench->graph->nodes, nodes_size);
+    scratch = path_scratch_new(&graph);
+
+    for (run = 0; run < 2; run++) {
+        memcpy(graph.nodes, bench->graph->nodes, nodes_size);
+        if (run == 1)
+            cache = pathcache_new(&graph, CACHE_ENTRIES, CACHE_ENTRIES * 256);
+
+        for (i = 0; i < queries; i++) {
+            const uint16_t s = pairs[2 * i], g = pairs[2 * i + 1];
+            size_t len = PATHCACHE_MISS;
+            float cost;
+
+            if (i % CACHE_CHANGE_EVERY == CACHE_CHANGE_EVERY - 1) {
+                const uint16_t node = changes[2 * (i / CACHE_CHANGE_EVERY)];
+                const unsigned edge = changes[2 * (i / CACHE_CHANGE_EVERY) + 1];
+                uint8_t *c = &graph.nodes[node].costs[edge];
+
+                if (*c != COST_BLOCKED) {
+                    *c = (*c < 128) ? 2 * *c : 255;
+                    if (cache) pathcache_cost_changed(cache, node, edge);
+                    if (run == 0) changed ++;
+                }
+            }
+
+            start = SDL_GetPerformanceCounter();
+            if (cache)
+                len = pathcache_find(cache, s, g, bench->corridor, CORRIDOR_MAX, &cost);
+            if (len == PATHCACHE_MISS) {
+                len = path_find(&graph, scratch, s, g, bench->corridor, CORRIDOR_MAX, &cost);
+                if (cache)
+                    pathcache_insert(cache, s, g, bench->corridor, len, cost);
+            }
+            if (run == 0) {
+                plain += seconds_since(start);
+                costs[i] = len ? cost : -1;
+            }
+            else {
+                cached += seconds_since(start);
+                if ((len ? cost : -1) != costs[i]
+                    && !(len && costs[i] > 0 && fabs(cost / costs[i] - 1) < 1e-5))
+                    wrong ++;
+            }
+        }
+    }
+
+    pathcache_stats(cache, &stats);
+    printf("%s: cache hit %.1f%% of %u queries, %zu invalidated by %u cost changes, "
+           "%zu evicted; %.1fx a* alone; %zu entries in %zuKB of %zuKB",
+           bench->name, stats.lookups ? 100.0 * stats.hits / stats.lookups : 0.0,
+           queries, stats.invalidated, changed, stats.evicted,
+           cached > 0 ? plain / cached : 0.0,
+           stats.entries, stats.memory_used / 1024, stats.memory / 1024);
+    if (wrong)
+        printf("; %zu differ from a*", wrong);
+    printf("\n");
+
+    pathcache_free(cache);
+    path_scratch_free(scratch);
+
+out:
+    free(pairs);
+    free(changes);
+    free(costs);
+    free(graph.nodes);
+}
+
+/* crowds of 100, 1000 and 10000 agents all heading for one goal: a* for
+ * each of them, against one flow field they all walk.  then costs change
+ * under the field a hundred times, each update checked at the end against
+ * a field built from scratch.  on copies of the nodes, with its own rng */
+#define FLOW_AGENTS         (10000)
+#define FLOW_CHANGES        (100)
+
+static const unsigned flow_crowds[] = { 100, 1000, 10000 };
+
+static void bench_flow(struct bench *bench)
+{
+    const size_t nodes_size = bench->graph->nodes_count * sizeof bench->graph->nodes[0];
+    struct trigraph graph = *bench->graph;
+    struct path_scratch *scratch = NULL;
+    struct flowfield field, fresh;
+    uint16_t *agents;
+    float *costs;
+    double astar[3], flow[3], elapsed = 0, build, update = 0, off = 0;
+    size_t crowd = 0, wrong = 0, expanded = 0;
+    const uint32_t saved = rng_state;
+    uint16_t goal;
+    Uint64 start;
+    unsigned i;
+
+    agents = malloc(FLOW_AGENTS * sizeof agents[0]);
+    costs = malloc(FLOW_AGENTS * sizeof costs[0]);
+    graph.nodes = malloc(nodes_size);
+    if (!agents || !costs || !graph.nodes) {
+        fprintf(stderr, "pathbench: out of memory\n");
+        goto out;
+    }
+    memcpy(graph.nodes, bench->graph->nodes, nodes_size);
+
+    rng_state = 3 * bench->queries + 1;
+    goal = rng() % graph.nodes_count;
+    for (i = 0; i < FLOW_AGENTS; i++)
+        agents[i] = rng() % graph.nodes_count;
+
+    scratch = path_scratch_new(&graph);
+    for (i = 0; i < FLOW_AGENTS; i++) {
+        float cost;
+
+        start = SDL_GetPerformanceCounter();
+        if (!path_find(&graph, scratch, agents[i], goal, bench->corridor, CORRIDOR_MAX, &cost))
+            cost = INFINITY;
+        elapsed += seconds_since(start);
+        costs[i] = cost;
+
+        if (i + 1 == flow_crowds[crowd])
+            astar[crowd++] = elapsed;
+    }
+
+    start = SDL_GetPerformanceCounter();
+    flowfield_build(&graph, goal, &field);
+    build = elapsed = seconds_since(start);
+    crowd = 0;
+    for (i = 0; i < FLOW_AGENTS; i++) {
+        start = SDL_GetPerformanceCounter();
+        flowfield_corridor(&field, agents[i], bench->corridor, CORRIDOR_MAX);
+        elapsed += seconds_since(start);
+
+        if (field.cost[agents[i]] != costs[i]
+            && !(costs[i] > 0 && fabs(field.cost[agents[i]] / costs[i] - 1) < 1e-5))
+            wrong ++;
+        if (i + 1 == flow_crowds[crowd])
+            flow[crowd++] = elapsed;
+    }
+
+    for (i = 0; i < sizeof flow_crowds / sizeof flow_crowds[0]; i++)
+        printf("%s: %u agents to one goal, a* %.2fms, flow field %.2fms "
+               "(%.2fms of it building), %.1fx\n",
+               bench->name, flow_crowds[i], 1000 * astar[i], 1000 * flow[i],
+               1000 * build, flow[i] > 0 ? astar[i] / flow[i] : 0.0);
+
+    /* blocked an eighth of the time, otherwise anywhere from a quarter to
+     * four times the default */
+    for (i = 0; i < FLOW_CHANGES; i++) {
+        const uint16_t node = rng() % graph.nodes_count;
+        const unsigned edge = rng() % 3;
+
+        graph.nodes[node].costs[edge] = (rng() % 8 == 0) ? COST_BLOCKED
+                                      : COST_DEFAULT / 4 + rng() % (4 * COST_DEFAULT);
+        start = SDL_GetPerformanceCounter();
+        flowfield_cost_changed(&graph, &field, node, edge);
+        update += seconds_since(start);
+        expanded += field.expanded;
+    }
+    rng_state = saved;
+
+    start = SDL_GetPerformanceCounter();
+    flowfield_build(&graph, goal, &fresh);
+    build = seconds_since(start);
+    for (i = 0; i < graph.nodes_count; i++) {
+        const float a = field.cost[i], b = fresh.cost[i];
+
+        if (a == b) continue;
+        if (a == INFINITY || b == INFINITY)
+            wrong ++;
+        else if (fabs(a / b - 1) > off)
+            off = fabs(a / b - 1);
+    }
+    flowfield_free(&fresh);
+
+    printf("%s: flow field updated for a changed cost in %.1fus, %.0f expanded, "
+           "against %.2fms to build it again; costs within %.1e of rebuilding",
+           bench->name, 1e6 * update / FLOW_CHANGES, (double) expanded / FLOW_CHANGES,
+           1000 * build, off);
+    if (wrong)
+        printf("; %zu disagree about reachability or with a*", wrong);
+    printf("\n");
+
+    flowfield_free(&field);
+
+out:
+    path_scratch_free(scratch);
+    free(agents);
+    free(costs);
+    free(graph.nodes);
+}
+
+/* runs slices of the queries as small batches, over and over, checking
+ * what each says it needed and expanded.  a thread taking two turns at a
+ * batch while another sat it out would get those wrong.  expanded[] has
+ * each slice's count from one thread, or is filled in when threads is 1.
+ * returns how many batches were off */
+static size_t bench_batch_small(struct bench *bench, struct batch_pool *pool,
+                                unsigned threads, const struct batch_request *requests,
+                                struct batch_result *results, uint16_t *arena,
+                                size_t arena_size, size_t *expanded)
+{
+    const unsigned slices = bench->queries / BATCH_SMALL;
+    size_t bad = 0, needed, want;
+    unsigned run, slice, i;
+
+    for (run = 0; run < (threads == 1 ? slices : BATCH_SMALL_RUNS); run++) {
+        slice = run % slices;
+
+        needed = batch_run(pool, &requests[slice * BATCH_SMALL], BATCH_SMALL,
+                           results, arena, arena_size);
+        for (i = 0, want = 0; i < BATCH_SMALL; i++)
+            want += bench->lengths[slice * BATCH_SMALL + i];
+
+        if (threads == 1)
+            expanded[slice] = batch_expanded(pool);
+        if (needed != want || batch_expanded(pool) != expanded[slice])
+            bad ++;
+    }
+
+    return bad;
+}
+
+/* a* alone, as the heaviest per query, so it's the threads that show.
+ * the arena is sized from a*'s own corridors, and every result is checked
+ * against them */
+static int bench_batch(struct bench *bench, unsigned threads_max)
+{
+    const unsigned queries = bench->queries;
+    struct batch_request *requests;
+    struct batch_result *results;
+    uint16_t *arena;
+    size_t arena_size = 0, *expanded;
+    double single = 0;
+    unsigned i, threads = 1;
+    int r = -1;
+
+    for (i = 0; i < queries; i++)
+        arena_size += bench->lengths[i];
+
+    requests = malloc(queries * sizeof requests[0]);
+    results = malloc(queries * sizeof results[0]);
+    arena = malloc((arena_size ? arena_size : 1) * sizeof arena[0]);
+    expanded = malloc((queries / BATCH_SMALL + 1) * sizeof expanded[0]);
+    if (!requests || !results || !arena || !expanded) {
+        fprintf(stderr, "pathbench: out of memory\n");
+        goto out;
+    }
+
+    for (i = 0; i < queries; i++) {
+        requests[i].start = bench->pairs[2 * i];
+        requests[i].goal = bench->pairs[2 * i + 1];
+    }
+
+    for (r = 0; r == 0; ) {
+        struct batch_pool *pool;
+        size_t needed, wrong = 0, small_bad = 0;
+        double elapsed;
+        Uint64 start;
+
+        pool = batch_pool_new(bench->graph, NULL, NULL, threads);
+        if (!pool) {
+            r = -1;
+            break;
+        }
+
+        /* once to fault the scratch in, then for real */
+        batch_run(pool, requests, queries, results, arena, arena_size);
+        start = SDL_GetPerformanceCounter();
+        needed = batch_run(pool, requests, queries, results, arena, arena_size);
+        elapsed = seconds_since(start);
+        if (threads == 1)
+            single = elapsed;
+
+        for (i = 0; i < queries; i++) {
+            const struct batch_result *result = &results[i];
+
+            if (result->len != bench->lengths[i]
+                || (result->len && (result->cost != bench->costs[i]
+                                    || result->corridor == BATCH_NO_ROOM
+                                    || arena[result->corridor] != requests[i].start
+                                    || arena[result->corridor + result->len - 1]
+                                           != requests[i].goal)))
+                wrong ++;
+        }
+
+        if (queries >= BATCH_SMALL)
+            small_bad = bench_batch_small(bench, pool, threads, requests, results,
+                                          arena, arena_size, expanded);
+
+        printf("%s: batch on %u thread%s in %.3fs, %.0f queries/s, %.2fx one thread",
+               bench->name, threads, threads == 1 ? "" : "s", elapsed,
+               elapsed > 0 ? queries / elapsed : 0.0,
+               elapsed > 0 ? single / elapsed : 0.0);
+        if (needed != arena_size)
+            printf("; needed %zu of the arena, not %zu", needed, arena_size);
+        if (wrong)
+            printf("; %zu differ from a*", wrong);
+        if (small_bad)
+            printf("; %zu of %u small batches miscounted", small_bad, BATCH_SMALL_RUNS);
+        printf("\n");
+        if (needed != arena_size || wrong || small_bad)
+            r = -1;
+
+        batch_pool_free(pool);
+        if (threads == threads_max)
+            break;
+        threads = (2 * threads < threads_max) ? 2 * threads : threads_max;
+    }
+
+out:
+    free(requests);
+    free(results);
+    free(expanded);
+    free(arena);
+    return r;
+}
+
+static int bench_graph(const char *name, const struct trigraph *graph,
+                       unsigned queries, unsigned threads)
+{
+    struct bench bench;
+    int r;
+
+    if (graph->nodes_count == 0) {
+        printf("%s: no nodes\n", name);
+        return 0;
+    }
+
+    if (bench_init(&bench, name, graph, queries) < 0) {
+        bench_fini(&bench);
+        return -1;
+    }
+
+    bench_locate(&bench);
+    bench_astar(&bench);
+    bench_hpa(&bench);
+    bench_ch(&bench);
+    bench_cache(&bench);
+    bench_flow(&bench);
+    r = bench_batch(&bench, threads);
+
+    bench_fini(&bench);
+    return r;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned queries = 2000, seed = 1, threads = SDL_GetCPUCount();
+    int i, r = 0;
+
+    for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+        if (!strcmp(argv[i], "-q") && i + 1 < argc)
+            queries = strtoul(argv[++i], NULL, 10);
+        else if (!strcmp(argv[i], "-s") && i + 1 < argc)
+            seed = strtoul(argv[++i], NULL, 10);
+        else if (!strcmp(argv[i], "-t") && i + 1 < argc)
+            threads = strtoul(argv[++i], NULL, 10);
+        else
+            break;
+    }
+
+    if ((i < argc && argv[i][0] == '-') || queries == 0 || threads == 0) {
+        fprintf(stderr, "usage: %s [-q queries] [-s seed] [-t threads] [map.tri ...]\n",
+                argv[0]);
+        return 2;
+    }
+
+    rng_state = seed ? seed : 1;
+
+    if (i == argc) {
+        size_t j;
+
+        for (j = 0; r == 0 && j < sizeof generated_sizes / sizeof generated_sizes[0]; j++) {
+            struct trigraph graph;
+            char name[32];
+
+            if (generate(generated_sizes[j], &graph) < 0)
+                return 1;
+
+            snprintf(name, sizeof name, "grid %ux%u",
+                     generated_sizes[j], generated_sizes[j]);
+            r = bench_graph(name, &graph, queries, threads);
+            mapc_trigraph_free(&graph);
+        }
+        return r < 0 ? 1 : 0;
+    }
+
+    for (; r == 0 && i < argc; i++) {
+        struct trigraph graph;
+
+        if (trigraph_load(argv[i], &graph) < 0)
+            return 1;
+
+        r = bench_graph(argv[i], &graph, queries, threads);
+        trigraph_unload(&graph);
+    }
+
+    return r < 0 ? 1 : 0;
+}
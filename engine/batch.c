@@ -0,0 +1,274 @@
+#include <assert.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <SDL.h>
+
+#include "engine/batch.h"
+#include "engine/path.h"
+
+#define CORRIDOR_MAX (INDEX_NULL + 1)
+
+struct batch_worker {
+    struct batch_pool *pool;
+    SDL_Thread *thread;
+    SDL_sem *go;                        /* posted once per batch */
+
+    struct path_scratch *scratch;
+    struct hpa_scratch *hpa_scratch;    /* if there's an hpa */
+    struct ch_scratch *ch_scratch;      /* if there's a ch */
+    uint16_t *corridor;                 /* until there's room for it */
+
+    size_t needed;                      /* arena this thread's corridors took */
+    size_t expanded;
+};
+
+struct batch_pool {
+    const struct trigraph *graph;
+    const struct hpa *hpa;
+    const struct ch *ch;
+
+    struct batch_worker *workers;
+    unsigned threads_count;
+    SDL_sem *finished;          /* posted back once by each thread per batch */
+    int shutdown;
+
+    /* the batch being run, read only while it is */
+    const struct batch_request *requests;
+    size_t count;
+    struct batch_result *results;
+    uint16_t *arena;
+    size_t arena_size;
+
+    SDL_atomic_t next;          /* first request not yet taken */
+    SDL_atomic_t used;          /* of the arena */
+};
+
+/* returns the corridor's length, 0 if there's no way */
+static size_t batch_find(struct batch_worker *worker, uint16_t start, uint16_t goal,
+                         float *cost)
+{
+    const struct batch_pool *pool = worker->pool;
+    size_t len;
+
+    if (start == INDEX_NULL || goal == INDEX_NULL)
+        return 0;
+
+    if (worker->ch_scratch) {
+        len = ch_find(pool->graph, pool->ch, worker->ch_scratch, start, goal,
+                      worker->corridor, CORRIDOR_MAX, cost);
+        worker->expanded += worker->ch_scratch->expanded;
+    }
+    else if (worker->hpa_scratch) {
+        len = hpa_find(pool->graph, pool->hpa, worker->hpa_scratch, start, goal,
+                       worker->corridor, CORRIDOR_MAX, cost);
+        worker->expanded += worker->hpa_scratch->expanded;
+    }
+    else {
+        len = path_find(pool->graph, worker->scratch, start, goal,
+                        worker->corridor, CORRIDOR_MAX, cost);
+        worker->expanded += worker->scratch->expanded;
+    }
+
+    return len;
+}
+
+/* claims len of the arena, or returns BATCH_NO_ROOM.  never takes more than
+ * there is, so what's left still goes to corridors short enough for it */
+static uint32_t batch_claim(struct batch_pool *pool, size_t len)
+{
+    for (;;) {
+        const int used = SDL_AtomicGet(&pool->used);
+
+        if ((size_t) used + len > pool->arena_size)
+            return BATCH_NO_ROOM;
+        if (SDL_AtomicCAS(&pool->used, used, used + (int) len))
+            return used;
+    }
+}
+
+static void batch_worker_take(struct batch_worker *worker)
+{
+    struct batch_pool *pool = worker->pool;
+    size_t i, end;
+
+    worker->needed = 0;
+    worker->expanded = 0;
+
+    for (;;) {
+        i = SDL_AtomicAdd(&pool->next, BATCH_CHUNK);
+        if (i >= pool->count)
+            break;
+        end = (i + BATCH_CHUNK < pool->count) ? i + BATCH_CHUNK : pool->count;
+
+        for (; i < end; i++) {
+            const struct batch_request *request = &pool->requests[i];
+            struct batch_result *result = &pool->results[i];
+            float cost = 0;
+            size_t len;
+
+            len = batch_find(worker, request->start, request->goal, &cost);
+            result->len = len;
+            result->cost = cost;
+            result->corridor = 0;
+            if (!len)
+                continue;
+
+            worker->needed += len;
+            result->corridor = batch_claim(pool, len);
+            if (result->corridor != BATCH_NO_ROOM)
+                memcpy(&pool->arena[result->corridor], worker->corridor,
+                       len * sizeof worker->corridor[0]);
+        }
+    }
+}
+
+static int batch_worker_run(void *data)
+{
+    struct batch_worker *worker = data;
+    struct batch_pool *pool = worker->pool;
+
+    for (;;) {
+        SDL_SemWait(worker->go);
+        if (pool->shutdown)
+            break;
+
+        batch_worker_take(worker);
+        SDL_SemPost(pool->finished);
+    }
+
+    return 0;
+}
+
+struct batch_pool *batch_pool_new(const struct trigraph *graph, const struct hpa *hpa,
+                                  const struct ch *ch, unsigned threads_count)
+{
+    struct batch_pool *pool;
+    unsigned i;
+
+    assert(threads_count > 0);
+
+    pool = calloc(1, sizeof *pool);
+    assert(pool != NULL);
+    pool->graph = graph;
+    pool->hpa = hpa;
+    pool->ch = ch;
+
+    pool->workers = calloc(threads_count, sizeof pool->workers[0]);
+    assert(pool->workers != NULL);
+
+    pool->finished = SDL_CreateSemaphore(0);
+    if (!pool->finished) {
+        fprintf(stderr, "batch: unable to create a semaphore: %s\n", SDL_GetError());
+        batch_pool_free(pool);
+        return NULL;
+    }
+
+    for (i = 0; i < threads_count; i++) {
+        struct batch_worker *worker = &pool->workers[i];
+
+        worker->pool = pool;
+        worker->scratch = path_scratch_new(graph);
+        if (ch)
+            worker->ch_scratch = ch_scratch_new(ch);
+        else if (hpa)
+            worker->hpa_scratch = hpa_scratch_new(graph, hpa);
+        worker->corridor = malloc(CORRIDOR_MAX * sizeof worker->corridor[0]);
+        assert(worker->corridor != NULL);
+
+        /* a semaphore each, so no thread can take two turns at one batch
+         * while another sits it out */
+        worker->go = SDL_CreateSemaphore(0);
+        if (!worker->go) {
+            fprintf(stderr, "batch: unable to create a semaphore: %s\n", SDL_GetError());
+            pool->threads_count = i + 1;
+            batch_pool_free(pool);
+            return NULL;
+        }
+
+        worker->thread = SDL_CreateThread(&batch_worker_run, "batch", worker);
+        if (!worker->thread) {
+            fprintf(stderr, "batch: unable to start a thread: %s\n", SDL_GetError());
+            pool->threads_count = i + 1;
+            batch_pool_free(pool);
+            return NULL;
+        }
+    }
+    pool->threads_count = threads_count;
+
+    return pool;
+}
+
+void batch_pool_free(struct batch_pool *pool)
+{
+    unsigned i;
+
+    if (!pool)
+        return;
+
+    pool->shutdown = 1;
+    for (i = 0; i < pool->threads_count; i++)
+        if (pool->workers[i].thread)
+            SDL_SemPost(pool->workers[i].go);
+
+    for (i = 0; i < pool->threads_count; i++) {
+        struct batch_worker *worker = &pool->workers[i];
+
+        if (worker->thread)
+            SDL_WaitThread(worker->thread, NULL);
+        if (worker->go)
+            SDL_DestroySemaphore(worker->go);
+        path_scratch_free(worker->scratch);
+        if (worker->hpa_scratch)
+            hpa_scratch_free(worker->hpa_scratch);
+        if (worker->ch_scratch)
+            ch_scratch_free(worker->ch_scratch);
+        free(worker->corridor);
+    }
+
+    if (pool->finished)
+        SDL_DestroySemaphore(pool->finished);
+    free(pool->workers);
+    free(pool);
+}
+
+size_t batch_run(struct batch_pool *pool,
+                 const struct batch_request *requests, size_t count,
+                 struct batch_result *results, uint16_t *arena, size_t arena_size)
+{
+    size_t needed = 0;
+    unsigned i;
+
+    /* the counters are ints, and each thread takes one chunk past the end
+     * before it stops */
+    assert(count <= INT_MAX - BATCH_CHUNK * (size_t) pool->threads_count);
+
+    pool->requests = requests;
+    pool->count = count;
+    pool->results = results;
+    pool->arena = arena;
+    pool->arena_size = (arena_size < INT_MAX) ? arena_size : INT_MAX;
+    SDL_AtomicSet(&pool->next, 0);
+    SDL_AtomicSet(&pool->used, 0);
+
+    for (i = 0; i < pool->threads_count; i++)
+        SDL_SemPost(pool->workers[i].go);
+    for (i = 0; i < pool->threads_count; i++)
+        SDL_SemWait(pool->finished);
+
+    for (i = 0; i < pool->threads_count; i++)
+        needed += pool->workers[i].needed;
+    return needed;
+}
+
+size_t batch_expanded(const struct batch_pool *pool)
+{
+    size_t expanded = 0;
+    unsigned i;
+
+    for (i = 0; i < pool->threads_count; i++)
+        expanded += pool->workers[i].expanded;
+    return expanded;
+}
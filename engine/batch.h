@@ -0,0 +1,53 @@
+#ifndef ENGINE_BATCH_H
+#define ENGINE_BATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "engine/ch.h"
+#include "engine/hpa.h"
+#include "engine/trigraph.h"
+
+/* answers a frame's worth of path queries at once, on a fixed pool of
+ * threads started up front.  each thread keeps its own scratch for as long
+ * as the pool lives, so nothing is allocated or locked per query; threads
+ * take requests a handful at a time off a shared counter, and copy each
+ * corridor into an arena the caller sized beforehand.  queries go through
+ * the contraction hierarchy if there is one, then the hpa, then plain a*,
+ * as the engine's own do; mapc only bakes a ch when asked (-C) */
+
+struct batch_request {
+    uint16_t start, goal;
+};
+
+struct batch_result {
+    uint32_t corridor;          /* offset into the arena, BATCH_NO_ROOM if
+                                 * the arena was full */
+    uint32_t len;               /* 0 if there's no way */
+    float cost;
+};
+
+#define BATCH_NO_ROOM       UINT32_MAX
+
+/* requests a thread takes at a time: enough that the shared counter isn't
+ * fought over, few enough that threads finish together */
+#define BATCH_CHUNK         16
+
+struct batch_pool;
+
+/* hpa and ch may be NULL, and must outlive the pool */
+struct batch_pool *batch_pool_new(const struct trigraph *graph, const struct hpa *hpa,
+                                  const struct ch *ch, unsigned threads_count);
+void batch_pool_free(struct batch_pool *pool);
+
+/* corridors land in the arena in whatever order threads finish them.
+ * returns the arena length the whole batch needed, which is more than
+ * arena_size if some of it didn't fit */
+size_t batch_run(struct batch_pool *pool,
+                 const struct batch_request *requests, size_t count,
+                 struct batch_result *results, uint16_t *arena, size_t arena_size);
+
+/* nodes expanded over the last batch, all threads together */
+size_t batch_expanded(const struct batch_pool *pool);
+
+#endif
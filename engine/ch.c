@@ -0,0 +1,779 @@
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/mman.h>
+
+#include "engine/ch.h"
+#include "engine/path.h"
+#include "engine/trifile.h"
+#include "engine/trigraph.h"
+
+/* how many nodes a witness search settles before giving up and letting a
+ * shortcut in.  fewer makes each search quicker, but the extra shortcuts
+ * slow down every search after */
+#define CH_WITNESS_SETTLED (256)
+
+/* a node's edges while the hierarchy is being built */
+struct ch_arcs {
+    struct ch_edge *edges;
+    size_t count;
+    size_t alloc;
+};
+
+/* one the node being taken out would need */
+struct ch_shortcut {
+    uint16_t from;
+    uint16_t to;
+    float cost;
+};
+
+struct ch_builder {
+    struct ch_arcs *out;        /* to nodes still in the graph */
+    struct ch_arcs *in;         /* from them, with to being where from */
+    uint32_t *deleted;          /* neighbours taken out so far */
+    uint16_t *level;            /* how far up the hierarchy it must be */
+    uint8_t *target;            /* what the witness search is looking for */
+    struct path_scratch *witness;
+    struct ch_shortcut *shortcuts;
+    size_t shortcuts_count;
+    size_t shortcuts_alloc;
+};
+
+static int edge_cmp(const void *a, const void *b)
+{
+    const struct ch_edge *x = a, *y = b;
+
+    return (x->to > y->to) - (x->to < y->to);
+}
+
+static void arcs_ensure(struct ch_arcs *arcs)
+{
+    if (arcs->count < arcs->alloc) return;
+
+    arcs->alloc = arcs->alloc ? 2 * arcs->alloc : 4;
+    arcs->edges = realloc(arcs->edges, arcs->alloc * sizeof arcs->edges[0]);
+    assert(arcs->edges != NULL);
+}
+
+/* adds an edge, or makes the one already there cheaper */
+static void arcs_add(struct ch_arcs *arcs, uint16_t to, uint16_t middle, float cost)
+{
+    struct ch_edge *edge;
+    size_t i;
+
+    for (i = 0; i < arcs->count; i++) {
+        edge = &arcs->edges[i];
+        if (edge->to != to) continue;
+
+        if (cost < edge->cost) {
+            edge->middle = middle;
+            edge->cost = cost;
+        }
+        return;
+    }
+
+    arcs_ensure(arcs);
+    edge = &arcs->edges[arcs->count++];
+    edge->to = to;
+    edge->middle = middle;
+    edge->cost = cost;
+}
+
+static void shortcuts_ensure(struct ch_builder *builder)
+{
+    if (builder->shortcuts_count < builder->shortcuts_alloc) return;
+
+    builder->shortcuts_alloc = builder->shortcuts_alloc ? 2 * builder->shortcuts_alloc : 64;
+    builder->shortcuts = realloc(builder->shortcuts,
+                                 builder->shortcuts_alloc * sizeof builder->shortcuts[0]);
+    assert(builder->shortcuts != NULL);
+}
+
+static void arcs_remove(struct ch_arcs *arcs, uint16_t to)
+{
+    size_t i;
+
+    for (i = 0; i < arcs->count; i++) {
+        if (arcs->edges[i].to == to) {
+            arcs->edges[i] = arcs->edges[--arcs->count];
+            return;
+        }
+    }
+}
+
+/* dijkstra from a node over what's left of the graph, going around the
+ * node being taken out, until it has settled every target, passed limit
+ * or settled enough.  anything it reached has a way there costing at most
+ * its g */
+static void witness_search(struct ch_builder *builder, uint16_t source,
+                           uint16_t skip, float limit, size_t targets)
+{
+    struct path_scratch *search = builder->witness;
+    struct path_node *nodes = search->nodes;
+    size_t settled = 0, i;
+    uint32_t gen;
+
+    gen = path_begin(search);
+
+    nodes[source].stamp = gen;
+    nodes[source].g = 0;
+    nodes[source].parent = INDEX_NULL;
+    path_open_push(search, source, 0);
+
+    while (targets && search->open_count && search->open[0].f <= limit
+           && settled < CH_WITNESS_SETTLED) {
+        const uint16_t current = path_open_pop(search);
+        const struct ch_arcs *out = &builder->out[current];
+
+        settled ++;
+        if (builder->target[current] && current != source)
+            targets --;
+
+        for (i = 0; i < out->count; i++) {
+            const uint16_t next = out->edges[i].to;
+            const float g = nodes[current].g + out->edges[i].cost;
+            struct path_node *n = &nodes[next];
+
+            if (next == skip) continue;
+
+            if (n->stamp != gen) {
+                n->stamp = gen;
+                n->g = g;
+                n->parent = current;
+                path_open_push(search, next, g);
+            }
+            else if (n->heap != PATH_CLOSED && g < n->g) {
+                n->g = g;
+                n->parent = current;
+                path_open_update(search, next, g);
+            }
+        }
+    }
+}
+
+/* the shortcuts taking a node out would need, in builder->shortcuts */
+static void contract(struct ch_builder *builder, uint16_t id)
+{
+    const struct ch_arcs *in = &builder->in[id], *out = &builder->out[id];
+    const struct path_node *nodes = builder->witness->nodes;
+    size_t targets, i, j;
+
+    builder->shortcuts_count = 0;
+
+    for (j = 0; j < out->count; j++)
+        builder->target[out->edges[j].to] = 1;
+
+    for (i = 0; i < in->count; i++) {
+        const uint16_t from = in->edges[i].to;
+        const float there = in->edges[i].cost;
+        float limit = -1;
+
+        targets = 0;
+        for (j = 0; j < out->count; j++) {
+            if (out->edges[j].to == from) continue;
+            if (there + out->edges[j].cost > limit)
+                limit = there + out->edges[j].cost;
+            targets ++;
+        }
+        if (!targets) continue;
+
+        witness_search(builder, from, id, limit, targets);
+
+        for (j = 0; j < out->count; j++) {
+            const uint16_t to = out->edges[j].to;
+            const float via = there + out->edges[j].cost;
+
+            if (to == from) continue;
+            if (nodes[to].stamp == builder->witness->generation && nodes[to].g <= via)
+                continue;
+
+            shortcuts_ensure(builder);
+            builder->shortcuts[builder->shortcuts_count].from = from;
+            builder->shortcuts[builder->shortcuts_count].to = to;
+            builder->shortcuts[builder->shortcuts_count].cost = via;
+            builder->shortcuts_count ++;
+        }
+    }
+
+    for (j = 0; j < out->count; j++)
+        builder->target[out->edges[j].to] = 0;
+}
+
+/* lower goes first: nodes that add fewer shortcuts than the edges they
+ * take away, mostly, but spread out over the map and not piled on top of
+ * each other.  leaves the shortcuts it would take in builder->shortcuts */
+static float priority(struct ch_builder *builder, uint16_t id)
+{
+    const size_t edges = builder->in[id].count + builder->out[id].count;
+
+    contract(builder, id);
+    return 2 * ((float) builder->shortcuts_count - (float) edges)
+           + builder->deleted[id] + builder->level[id];
+}
+
+/* a neighbour of a node just taken out has to go above it */
+static void neighbour_gone(struct ch_builder *builder, uint16_t id, uint16_t neighbour)
+{
+    builder->deleted[neighbour] ++;
+    if (builder->level[neighbour] <= builder->level[id])
+        builder->level[neighbour] = builder->level[id] + 1;
+}
+
+/* one edge list per rank, renumbered by rank and each sorted by to */
+static struct ch_edge *pack(struct ch_arcs *arcs, const struct ch *ch,
+                            uint32_t *first, size_t *count, size_t *shortcuts)
+{
+    struct ch_edge *edges;
+    size_t r, i, j;
+
+    *count = 0;
+    for (i = 0; i < ch->nodes_count; i++)
+        *count += arcs[i].count;
+
+    edges = malloc((*count + 1) * sizeof edges[0]);
+    assert(edges != NULL);
+
+    for (r = j = 0; r < ch->nodes_count; r++) {
+        const struct ch_arcs *from = &arcs[ch->order[r]];
+
+        first[r] = j;
+        for (i = 0; i < from->count; i++, j++) {
+            edges[j].to = ch->rank[from->edges[i].to];
+            edges[j].middle = (from->edges[i].middle == INDEX_NULL)
+                              ? INDEX_NULL : ch->rank[from->edges[i].middle];
+            edges[j].cost = from->edges[i].cost;
+            if (edges[j].middle != INDEX_NULL)
+                (*shortcuts) ++;
+        }
+        qsort(&edges[first[r]], j - first[r], sizeof edges[0], &edge_cmp);
+    }
+    first[ch->nodes_count] = j;
+
+    return edges;
+}
+
+/* builds the hierarchy for a trigraph from scratch, using its costs as
+ * they stand.  nodes are taken out cheapest first, by a priority that is
+ * only checked again when a node comes up, as it only ever goes stale */
+void ch_build(const struct trigraph *graph, struct ch *ch)
+{
+    struct ch_builder builder;
+    struct path_scratch *queue;
+    const size_t n = graph->nodes_count;
+    size_t rank = 0, i, j;
+
+    memset(ch, 0, sizeof *ch);
+    ch->nodes_count = n;
+
+    builder.out = calloc(n + 1, sizeof builder.out[0]);
+    builder.in = calloc(n + 1, sizeof builder.in[0]);
+    builder.deleted = calloc(n + 1, sizeof builder.deleted[0]);
+    builder.level = calloc(n + 1, sizeof builder.level[0]);
+    builder.target = calloc(n + 1, sizeof builder.target[0]);
+    ch->rank = malloc((n + 1) * sizeof ch->rank[0]);
+    ch->order = malloc((n + 1) * sizeof ch->order[0]);
+    ch->up_first = malloc((n + 1) * sizeof ch->up_first[0]);
+    ch->down_first = malloc((n + 1) * sizeof ch->down_first[0]);
+    assert(builder.out != NULL && builder.in != NULL);
+    assert(builder.deleted != NULL && builder.level != NULL && builder.target != NULL);
+    assert(ch->rank != NULL && ch->order != NULL);
+    assert(ch->up_first != NULL && ch->down_first != NULL);
+    builder.witness = path_scratch_new(graph);
+    builder.shortcuts = NULL;
+    builder.shortcuts_count = builder.shortcuts_alloc = 0;
+
+    for (i = 0; i < n; i++) {
+        for (j = 0; j < 3; j++) {
+            const uint16_t next = graph->nodes[i].neighbours[j];
+            const float step = path_step(builder.witness, graph, i, j);
+
+            if (step < 0) continue;
+            arcs_add(&builder.out[i], next, INDEX_NULL, step);
+            arcs_add(&builder.in[next], i, INDEX_NULL, step);
+        }
+    }
+
+    queue = path_scratch_alloc(n);
+    path_begin(queue);
+    for (i = 0; i < n; i++)
+        path_open_push(queue, i, priority(&builder, i));
+
+    while (queue->open_count) {
+        const uint16_t id = path_open_pop(queue);
+        const float p = priority(&builder, id);
+
+        if (queue->open_count && p > queue->open[0].f) {
+            path_open_push(queue, id, p);
+            continue;
+        }
+
+        for (i = 0; i < builder.shortcuts_count; i++) {
+            const struct ch_shortcut *shortcut = &builder.shortcuts[i];
+
+            arcs_add(&builder.out[shortcut->from], shortcut->to, id, shortcut->cost);
+            arcs_add(&builder.in[shortcut->to], shortcut->from, id, shortcut->cost);
+        }
+        ch->rank[id] = rank;
+        ch->order[rank++] = id;
+
+        /* what's left of its edges all lead up the hierarchy, and are
+         * kept as they are.  its neighbours forget it */
+        for (i = 0; i < builder.out[id].count; i++) {
+            const uint16_t to = builder.out[id].edges[i].to;
+
+            arcs_remove(&builder.in[to], id);
+            neighbour_gone(&builder, id, to);
+        }
+        for (i = 0; i < builder.in[id].count; i++) {
+            const uint16_t from = builder.in[id].edges[i].to;
+
+            arcs_remove(&builder.out[from], id);
+            neighbour_gone(&builder, id, from);
+        }
+    }
+
+    ch->up = pack(builder.out, ch, ch->up_first, &ch->up_count, &ch->shortcuts_count);
+    ch->down = pack(builder.in, ch, ch->down_first, &ch->down_count, &ch->shortcuts_count);
+
+    for (i = 0; i < n; i++) {
+        free(builder.out[i].edges);
+        free(builder.in[i].edges);
+    }
+    free(builder.out);
+    free(builder.in);
+    free(builder.deleted);
+    free(builder.level);
+    free(builder.target);
+    free(builder.shortcuts);
+    path_scratch_free(builder.witness);
+    path_scratch_free(queue);
+}
+
+int ch_write(const char *filename, const struct trigraph *graph, const struct ch *ch)
+{
+    struct trifile_blob blobs[7];
+    struct ch_params params;
+
+    memset(&params, 0, sizeof params);
+    params.base_check = graph->check;
+    params.up_count = ch->up_count;
+    params.down_count = ch->down_count;
+    params.shortcuts_count = ch->shortcuts_count;
+
+    blobs[0].tag = CH_PARAMS;
+    blobs[0].data = &params;
+    blobs[0].size = sizeof params;
+    blobs[1].tag = CH_RANK;
+    blobs[1].data = ch->rank;
+    blobs[1].size = ch->nodes_count * sizeof ch->rank[0];
+    blobs[2].tag = CH_ORDER;
+    blobs[2].data = ch->order;
+    blobs[2].size = ch->nodes_count * sizeof ch->order[0];
+    blobs[3].tag = CH_UP_FIRST;
+    blobs[3].data = ch->up_first;
+    blobs[3].size = (ch->nodes_count + 1) * sizeof ch->up_first[0];
+    blobs[4].tag = CH_UP;
+    blobs[4].data = ch->up;
+    blobs[4].size = ch->up_count * sizeof ch->up[0];
+    blobs[5].tag = CH_DOWN_FIRST;
+    blobs[5].data = ch->down_first;
+    blobs[5].size = (ch->nodes_count + 1) * sizeof ch->down_first[0];
+    blobs[6].tag = CH_DOWN;
+    blobs[6].data = ch->down;
+    blobs[6].size = ch->down_count * sizeof ch->down[0];
+
+    return trifile_write(filename, graph->nodes_count, graph->vertices_count,
+                         blobs, 7, NULL);
+}
+
+/* the edge from one rank to another, kept with whichever is lower, or
+ * NULL if there's none.  the lists are short, so a scan beats bsearch */
+static const struct ch_edge *ch_edge_between(const struct ch *ch, uint16_t from,
+                                             uint16_t to)
+{
+    const struct ch_edge *edges;
+    uint32_t e, last;
+    uint16_t other;
+
+    if (from < to) {
+        edges = ch->up;
+        e = ch->up_first[from];
+        last = ch->up_first[from + 1];
+        other = to;
+    }
+    else {
+        edges = ch->down;
+        e = ch->down_first[to];
+        last = ch->down_first[to + 1];
+        other = from;
+    }
+
+    for (; e < last && edges[e].to < other; e++)
+        ;
+    return (e < last && edges[e].to == other) ? &edges[e] : NULL;
+}
+
+static const char *ch_section(const struct trifile *file, uint32_t tag,
+                              void **data, size_t size)
+{
+    const char *error;
+    size_t found;
+
+    if ((error = trifile_section(file, tag, data, &found)))
+        return error;
+    if (found != size)
+        return "section size doesn't match its count";
+    return NULL;
+}
+
+static int is_neighbour(const struct trigraph *graph, uint16_t id, uint16_t other)
+{
+    const struct trinode *node = &graph->nodes[id];
+
+    return node->neighbours[0] == other || node->neighbours[1] == other
+           || node->neighbours[2] == other;
+}
+
+/* one way's edges are in order and lead up, trigraph edges join
+ * neighbours, and shortcuts skip a rank below both ends */
+static const char *validate_edges(const struct trigraph *graph, const struct ch *ch,
+                                  const uint32_t *first, const struct ch_edge *edges,
+                                  size_t count, int down)
+{
+    size_t i, j;
+
+    if (first[0] != 0 || first[ch->nodes_count] != count)
+        return "edges don't cover the nodes";
+    for (i = 0; i < ch->nodes_count; i++) {
+        if (first[i] > first[i + 1])
+            return "edges out of order";
+    }
+
+    for (i = 0; i < ch->nodes_count; i++) {
+        for (j = first[i]; j < first[i + 1]; j++) {
+            const struct ch_edge *edge = &edges[j];
+
+            if (edge->to >= ch->nodes_count || edge->to <= i
+                || !(edge->cost >= 0) || isinf(edge->cost))
+                return "bad edge";
+            if (j > first[i] && edge->to <= edges[j - 1].to)
+                return "edges out of order";
+        }
+    }
+
+    for (i = 0; i < ch->nodes_count; i++) {
+        for (j = first[i]; j < first[i + 1]; j++) {
+            const uint16_t from = down ? edges[j].to : i;
+            const uint16_t to = down ? i : edges[j].to;
+            const uint16_t middle = edges[j].middle;
+
+            if (middle == INDEX_NULL) {
+                if (!is_neighbour(graph, ch->order[from], ch->order[to]))
+                    return "edge between nodes that aren't neighbours";
+                continue;
+            }
+
+            if (middle >= from || middle >= to)
+                return "bad shortcut";
+            if (!ch_edge_between(ch, from, middle) || !ch_edge_between(ch, middle, to))
+                return "shortcut skips a missing edge";
+        }
+    }
+
+    return NULL;
+}
+
+/* everything the search and unpacking will take on trust later */
+static const char *validate(const struct trigraph *graph, const struct ch *ch)
+{
+    const char *error;
+    size_t i;
+
+    for (i = 0; i < ch->nodes_count; i++) {
+        if (ch->rank[i] >= ch->nodes_count || ch->order[ch->rank[i]] != i)
+            return "ranks aren't one per node";
+    }
+
+    /* both ways in order before either's shortcuts are looked up */
+    if ((error = validate_edges(graph, ch, ch->up_first, ch->up, ch->up_count, 0)))
+        return error;
+    if ((error = validate_edges(graph, ch, ch->down_first, ch->down, ch->down_count, 1)))
+        return error;
+
+    return NULL;
+}
+
+static const char *ch_apply(const struct trifile *file, const struct trigraph *graph,
+                            struct ch *ch)
+{
+    struct ch_params *params;
+    const char *error;
+    void *data;
+
+    if (file->header.nodes_count != graph->nodes_count
+        || file->header.vertices_count != graph->vertices_count)
+        return "made for a different trigraph";
+
+    if ((error = ch_section(file, CH_PARAMS, &data, sizeof *params)))
+        return error;
+    params = data;
+
+    if (params->base_check != graph->check)
+        return "made for a different trigraph";
+
+    ch->nodes_count = graph->nodes_count;
+    ch->up_count = params->up_count;
+    ch->down_count = params->down_count;
+    ch->shortcuts_count = params->shortcuts_count;
+
+    if ((error = ch_section(file, CH_RANK, &data,
+                            ch->nodes_count * sizeof ch->rank[0])))
+        return error;
+    ch->rank = data;
+    if ((error = ch_section(file, CH_ORDER, &data,
+                            ch->nodes_count * sizeof ch->order[0])))
+        return error;
+    ch->order = data;
+    if ((error = ch_section(file, CH_UP_FIRST, &data,
+                            (ch->nodes_count + 1) * sizeof ch->up_first[0])))
+        return error;
+    ch->up_first = data;
+    if ((error = ch_section(file, CH_UP, &data, ch->up_count * sizeof ch->up[0])))
+        return error;
+    ch->up = data;
+    if ((error = ch_section(file, CH_DOWN_FIRST, &data,
+                            (ch->nodes_count + 1) * sizeof ch->down_first[0])))
+        return error;
+    ch->down_first = data;
+    if ((error = ch_section(file, CH_DOWN, &data, ch->down_count * sizeof ch->down[0])))
+        return error;
+    ch->down = data;
+
+    return validate(graph, ch);
+}
+
+/* maps the hierarchy mapc baked alongside a trigraph.  returns -1 (having
+ * said why) if it's no good, or was baked from some other trigraph */
+int ch_load(const char *filename, const struct trigraph *graph, struct ch *ch)
+{
+    struct trifile file;
+    const char *error;
+
+    memset(ch, 0, sizeof *ch);
+
+    if (trifile_open(filename, &file) < 0)
+        return -1;
+
+    ch->file = file.data;
+    ch->file_size = file.size;
+
+    error = ch_apply(&file, graph, ch);
+    if (error) {
+        fprintf(stderr, "%s: %s\n", filename, error);
+        ch_free(ch);
+        return -1;
+    }
+
+    return 0;
+}
+
+void ch_free(struct ch *ch)
+{
+    if (ch->file) {
+        munmap(ch->file, ch->file_size);
+    }
+    else {
+        free(ch->rank);
+        free(ch->order);
+        free(ch->up_first);
+        free(ch->up);
+        free(ch->down_first);
+        free(ch->down);
+    }
+    memset(ch, 0, sizeof *ch);
+}
+
+struct ch_scratch *ch_scratch_new(const struct ch *ch)
+{
+    struct ch_scratch *scratch;
+
+    scratch = malloc(sizeof *scratch);
+    assert(scratch != NULL);
+
+    scratch->forward = path_scratch_alloc(ch->nodes_count);
+    scratch->backward = path_scratch_alloc(ch->nodes_count);
+    scratch->route = malloc((ch->nodes_count + 1) * sizeof scratch->route[0]);
+    scratch->stack = malloc((ch->nodes_count + 1) * sizeof scratch->stack[0]);
+    assert(scratch->route != NULL && scratch->stack != NULL);
+    scratch->expanded = 0;
+
+    return scratch;
+}
+
+void ch_scratch_free(struct ch_scratch *scratch)
+{
+    if (!scratch) return;
+
+    path_scratch_free(scratch->forward);
+    path_scratch_free(scratch->backward);
+    free(scratch->route);
+    free(scratch->stack);
+    free(scratch);
+}
+
+static void ch_append(uint16_t *corridor, size_t corridor_max, size_t *len,
+                      uint16_t id)
+{
+    if (*len < corridor_max)
+        corridor[*len] = id;
+    (*len) ++;
+}
+
+/* whether some node above this one reaches it more cheaply than the
+ * search did, in which case nothing through it can be the cheapest */
+static int ch_stalled(const struct ch *ch, const struct path_scratch *search,
+                      uint16_t id, int backward)
+{
+    const uint32_t *first = backward ? ch->up_first : ch->down_first;
+    const struct ch_edge *edges = backward ? ch->up : ch->down;
+    const float g = search->nodes[id].g;
+    uint32_t e;
+
+    for (e = first[id]; e < first[id + 1]; e++) {
+        const struct path_node *n = &search->nodes[edges[e].to];
+
+        if (n->stamp == search->generation && n->g + edges[e].cost < g)
+            return 1;
+    }
+
+    return 0;
+}
+
+/* as path_find, with the same cost, but climbing the hierarchy from both
+ * ends at once.  the corridor is only written as far as it fits, but its
+ * length is returned either way.  the hierarchy keeps the costs it was
+ * built with, so rebuild it after changing them */
+size_t ch_find(const struct trigraph *graph, const struct ch *ch,
+               struct ch_scratch *scratch, uint16_t start, uint16_t goal,
+               uint16_t *corridor, size_t corridor_max, float *cost)
+{
+    struct path_scratch *searches[2];
+    const uint16_t ends[2] = { ch->rank[start], ch->rank[goal] };
+    float best = INFINITY;
+    uint16_t meet = INDEX_NULL, id;
+    size_t route_len = 0, len = 0, depth, i;
+    int side;
+
+    assert(ch->nodes_count == graph->nodes_count);
+    assert(start < graph->nodes_count && goal < graph->nodes_count);
+
+    searches[0] = scratch->forward;
+    searches[1] = scratch->backward;
+    scratch->expanded = 0;
+
+    for (side = 0; side < 2; side++) {
+        struct path_node *n = &searches[side]->nodes[ends[side]];
+
+        path_begin(searches[side]);
+        n->stamp = searches[side]->generation;
+        n->g = 0;
+        n->parent = INDEX_NULL;
+        path_open_push(searches[side], ends[side], 0);
+    }
+
+    for (;;) {
+        const uint32_t *first;
+        const struct ch_edge *edges;
+        struct path_scratch *search;
+        const struct path_node *there;
+        uint16_t current;
+        uint32_t e;
+
+        /* whichever way has the cheaper node next, as long as it could
+         * still lead to a cheaper meeting */
+        side = -1;
+        for (i = 0; i < 2; i++) {
+            const struct path_scratch *s = searches[i];
+
+            if (s->open_count && s->open[0].f < best
+                && (side < 0 || s->open[0].f < searches[side]->open[0].f))
+                side = i;
+        }
+        if (side < 0) break;
+
+        search = searches[side];
+        current = path_open_pop(search);
+        scratch->expanded ++;
+
+        there = &searches[!side]->nodes[current];
+        if (there->stamp == searches[!side]->generation
+            && search->nodes[current].g + there->g < best) {
+            best = search->nodes[current].g + there->g;
+            meet = current;
+        }
+
+        if (ch_stalled(ch, search, current, side))
+            continue;
+
+        first = side ? ch->down_first : ch->up_first;
+        edges = side ? ch->down : ch->up;
+
+        for (e = first[current]; e < first[current + 1]; e++) {
+            const uint16_t next = edges[e].to;
+            const float g = search->nodes[current].g + edges[e].cost;
+            struct path_node *n = &search->nodes[next];
+
+            if (n->stamp != search->generation) {
+                n->stamp = search->generation;
+                n->g = g;
+                n->parent = current;
+                path_open_push(search, next, g);
+            }
+            else if (n->heap != PATH_CLOSED && g < n->g) {
+                n->g = g;
+                n->parent = current;
+                path_open_update(search, next, g);
+            }
+        }
+    }
+
+    if (meet == INDEX_NULL)
+        return 0;
+    if (cost) *cost = best;
+
+    /* up from the start to where the searches met, then down to the goal */
+    for (id = meet; id != INDEX_NULL; id = scratch->forward->nodes[id].parent)
+        route_len ++;
+    i = route_len;
+    for (id = meet; id != INDEX_NULL; id = scratch->forward->nodes[id].parent)
+        scratch->route[--i] = id;
+    for (id = scratch->backward->nodes[meet].parent; id != INDEX_NULL;
+         id = scratch->backward->nodes[id].parent)
+        scratch->route[route_len++] = id;
+
+    /* and every shortcut on the way unpacked, first half first */
+    ch_append(corridor, corridor_max, &len, ch->order[scratch->route[0]]);
+    for (i = 0; i + 1 < route_len; i++) {
+        depth = 0;
+        scratch->stack[depth++] = (uint32_t) scratch->route[i] << 16 | scratch->route[i + 1];
+
+        while (depth) {
+            const uint32_t top = scratch->stack[--depth];
+            const struct ch_edge *edge = ch_edge_between(ch, top >> 16, top & 0xffff);
+
+            assert(edge != NULL);
+            if (edge->middle == INDEX_NULL) {
+                ch_append(corridor, corridor_max, &len, ch->order[top & 0xffff]);
+                continue;
+            }
+
+            scratch->stack[depth++] = (uint32_t) edge->middle << 16 | (top & 0xffff);
+            scratch->stack[depth++] = (top & 0xffff0000) | edge->middle;
+        }
+    }
+
+    return len;
+}
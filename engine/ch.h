@@ -0,0 +1,93 @@
+#ifndef ENGINE_CH_H
+#define ENGINE_CH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "engine/path.h"
+#include "engine/trifile.h"
+#include "engine/trigraph.h"
+
+/* a contraction hierarchy over a trigraph, for exact long queries.
+ * trinodes are taken out one at a time, least important first, and
+ * wherever that would make the cheapest way between two of a node's
+ * neighbours dearer, a shortcut between them stands in for it.  each
+ * node's rank is when it was taken out.  a query then only ever climbs,
+ * forwards from the start and backwards from the goal, and the cheapest
+ * place the two meet is the cheapest path once its shortcuts are unpacked.
+ * the edges number nodes by rank rather than as the trigraph does, so the
+ * few near the top that every long query climbs to sit together.
+ *
+ * baked next to the trigraph as map.ch, a trifile with sections:
+ *   CH_PARAMS          struct ch_params
+ *   CH_RANK            uint16_t[nodes_count], each trinode's rank
+ *   CH_ORDER           uint16_t[nodes_count], the trinode at each rank
+ *   CH_UP_FIRST        uint32_t[nodes_count + 1], each rank's first up edge
+ *   CH_UP              struct ch_edge[up_count], from each rank to those
+ *                      above it, by to
+ *   CH_DOWN_FIRST      uint32_t[nodes_count + 1]
+ *   CH_DOWN            struct ch_edge[down_count], into each rank from
+ *                      those above it, by to (which is where they come
+ *                      from)
+ */
+#define CH_PARAMS           TRIFILE_TAG('C','H','P','R')
+#define CH_RANK             TRIFILE_TAG('C','H','R','K')
+#define CH_ORDER            TRIFILE_TAG('C','H','O','R')
+#define CH_UP_FIRST         TRIFILE_TAG('C','H','U','F')
+#define CH_UP               TRIFILE_TAG('C','H','U','P')
+#define CH_DOWN_FIRST       TRIFILE_TAG('C','H','D','F')
+#define CH_DOWN             TRIFILE_TAG('C','H','D','N')
+
+struct ch_params {
+    uint32_t base_check;        /* header_check of the trigraph file */
+    uint32_t up_count;
+    uint32_t down_count;
+    uint32_t shortcuts_count;
+};
+
+struct ch_edge {
+    uint16_t to;
+    uint16_t middle;            /* the rank a shortcut skips, INDEX_NULL for
+                                 * an edge of the trigraph itself */
+    float cost;
+};
+
+struct ch {
+    size_t nodes_count;
+    size_t up_count;
+    size_t down_count;
+    size_t shortcuts_count;
+    uint16_t *rank;
+    uint16_t *order;
+    uint32_t *up_first;
+    struct ch_edge *up;
+    uint32_t *down_first;
+    struct ch_edge *down;
+
+    void *file;                 /* the mapping everything points into, if any */
+    size_t file_size;
+};
+
+/* per thread, as with struct path_scratch */
+struct ch_scratch {
+    struct path_scratch *forward;
+    struct path_scratch *backward;
+    uint16_t *route;            /* ranks the search met, start to goal */
+    uint32_t *stack;            /* edges still to unpack, from << 16 | to */
+
+    size_t expanded;            /* by the last query, both ways */
+};
+
+void ch_build(const struct trigraph *graph, struct ch *ch);
+int ch_write(const char *filename, const struct trigraph *graph, const struct ch *ch);
+int ch_load(const char *filename, const struct trigraph *graph, struct ch *ch);
+void ch_free(struct ch *ch);
+
+struct ch_scratch *ch_scratch_new(const struct ch *ch);
+void ch_scratch_free(struct ch_scratch *scratch);
+
+size_t ch_find(const struct trigraph *graph, const struct ch *ch,
+               struct ch_scratch *scratch, uint16_t start, uint16_t goal,
+               uint16_t *corridor, size_t corridor_max, float *cost);
+
+#endif
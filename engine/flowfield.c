@@ -0,0 +1,249 @@
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "engine/flowfield.h"
+#include "engine/path.h"
+#include "engine/trigraph.h"
+
+/* what it costs to step from a node into one of its neighbours, or a
+ * negative number if it can't */
+static float step_into(const struct trigraph *graph, const struct path_scratch *scratch,
+                       uint16_t from, uint16_t to)
+{
+    unsigned j;
+
+    for (j = 0; j < 3; j++)
+        if (graph->nodes[from].neighbours[j] == to)
+            return path_step(scratch, graph, from, j);
+    return -1;
+}
+
+void flowfield_build(const struct trigraph *graph, uint16_t goal, struct flowfield *field)
+{
+    const size_t n = graph->nodes_count;
+    struct path_node *nodes;
+    size_t i;
+
+    assert(goal < n);
+
+    memset(field, 0, sizeof *field);
+    field->nodes_count = n;
+    field->goal = goal;
+    field->next = malloc((n + 1) * sizeof field->next[0]);
+    field->cost = malloc((n + 1) * sizeof field->cost[0]);
+    field->queue = malloc((n + 1) * sizeof field->queue[0]);
+    assert(field->next != NULL && field->cost != NULL && field->queue != NULL);
+    field->scratch = path_scratch_new(graph);
+
+    /* backwards, so each node's g is its cost to the goal and its parent
+     * the neighbour it was reached from, which is the next step there */
+    path_flood(graph, field->scratch, goal, 0, n, 1);
+    field->expanded = field->scratch->expanded;
+
+    nodes = field->scratch->nodes;
+    for (i = 0; i < n; i++) {
+        if (nodes[i].stamp == field->scratch->generation) {
+            field->cost[i] = nodes[i].g;
+            field->next[i] = nodes[i].parent;
+        }
+        else {
+            field->cost[i] = INFINITY;
+            field->next[i] = INDEX_NULL;
+        }
+    }
+}
+
+void flowfield_free(struct flowfield *field)
+{
+    free(field->next);
+    free(field->cost);
+    free(field->queue);
+    path_scratch_free(field->scratch);
+    memset(field, 0, sizeof *field);
+}
+
+/* dijkstra on from whatever's on the heap, each node popped passing its
+ * cost on to the neighbours that can step into it.  a node seen this time
+ * round has a stamp of gen, and g INFINITY until it's been pushed.  with
+ * within, only those are touched */
+static void flowfield_spread(const struct trigraph *graph, struct flowfield *field,
+                             uint32_t gen, int within)
+{
+    struct path_scratch *scratch = field->scratch;
+    struct path_node *nodes = scratch->nodes;
+
+    while (scratch->open_count) {
+        const uint16_t current = path_open_pop(scratch);
+        const struct trinode *node = &graph->nodes[current];
+        unsigned i;
+
+        scratch->expanded ++;
+
+        for (i = 0; i < 3; i++) {
+            const uint16_t w = node->neighbours[i];
+            struct path_node *n;
+            float step, g;
+
+            if (w == INDEX_NULL)
+                continue;
+
+            n = &nodes[w];
+            if (n->stamp != gen) {
+                if (within) continue;
+                n->stamp = gen;
+                n->g = INFINITY;
+            }
+
+            step = step_into(graph, scratch, w, current);
+            if (step < 0) continue;
+            g = field->cost[current] + step;
+            if (g >= field->cost[w]) continue;
+
+            if (n->g == INFINITY) {
+                n->g = g;
+                path_open_push(scratch, w, g);
+            }
+            else if (n->heap != PATH_CLOSED) {
+                n->g = g;
+                path_open_update(scratch, w, g);
+            }
+            else {
+                continue;
+            }
+
+            field->cost[w] = g;
+            field->next[w] = current;
+        }
+    }
+}
+
+/* node has a cheaper way through to, which may be cheaper for the nodes
+ * around it too */
+static void flowfield_cheaper(const struct trigraph *graph, struct flowfield *field,
+                              uint16_t node, uint16_t to, float cost)
+{
+    struct path_scratch *scratch = field->scratch;
+    const uint32_t gen = path_begin(scratch);
+
+    field->cost[node] = cost;
+    field->next[node] = to;
+
+    scratch->nodes[node].stamp = gen;
+    scratch->nodes[node].g = cost;
+    path_open_push(scratch, node, cost);
+
+    flowfield_spread(graph, field, gen, 0);
+}
+
+/* node's way to the goal got dearer, and so did everything's whose way
+ * went through it.  nothing else's can have got cheaper, so clear just
+ * those and fill them back in from the nodes around them */
+static void flowfield_dearer(const struct trigraph *graph, struct flowfield *field,
+                             uint16_t node)
+{
+    struct path_scratch *scratch = field->scratch;
+    struct path_node *nodes = scratch->nodes;
+    const uint32_t gen = path_begin(scratch);
+    size_t count = 0, head, i, j;
+
+    nodes[node].stamp = gen;
+    field->queue[count++] = node;
+
+    for (head = 0; head < count; head++) {
+        const uint16_t current = field->queue[head];
+
+        for (i = 0; i < 3; i++) {
+            const uint16_t w = graph->nodes[current].neighbours[i];
+
+            if (w != INDEX_NULL && field->next[w] == current && nodes[w].stamp != gen) {
+                nodes[w].stamp = gen;
+                field->queue[count++] = w;
+            }
+        }
+    }
+
+    for (i = 0; i < count; i++) {
+        const uint16_t current = field->queue[i];
+
+        field->cost[current] = INFINITY;
+        field->next[current] = INDEX_NULL;
+        nodes[current].g = INFINITY;
+    }
+
+    for (i = 0; i < count; i++) {
+        const uint16_t current = field->queue[i];
+
+        for (j = 0; j < 3; j++) {
+            const uint16_t y = graph->nodes[current].neighbours[j];
+            float step, g;
+
+            if (y == INDEX_NULL || nodes[y].stamp == gen)
+                continue;
+
+            step = path_step(scratch, graph, current, j);
+            if (step < 0) continue;
+            g = field->cost[y] + step;
+            if (g >= field->cost[current]) continue;
+
+            field->cost[current] = g;
+            field->next[current] = y;
+        }
+
+        if (field->next[current] != INDEX_NULL) {
+            nodes[current].g = field->cost[current];
+            path_open_push(scratch, current, field->cost[current]);
+        }
+    }
+
+    flowfield_spread(graph, field, gen, 1);
+}
+
+void flowfield_cost_changed(const struct trigraph *graph, struct flowfield *field,
+                            uint16_t node, unsigned edge)
+{
+    const uint16_t to = graph->nodes[node].neighbours[edge];
+    float step, g;
+
+    assert(node < field->nodes_count && edge < 3);
+
+    field->expanded = 0;
+    if (to == INDEX_NULL)
+        return;
+
+    step = path_step(field->scratch, graph, node, edge);
+    g = (step < 0) ? INFINITY : field->cost[to] + step;
+
+    if (g < field->cost[node])
+        flowfield_cheaper(graph, field, node, to, g);
+    else if (field->next[node] == to && g > field->cost[node])
+        flowfield_dearer(graph, field, node);
+    else
+        return;
+
+    field->expanded = field->scratch->expanded;
+}
+
+/* writes as much as fits, and returns the full length, 0 if there's no way */
+size_t flowfield_corridor(const struct flowfield *field, uint16_t start,
+                          uint16_t *corridor, size_t corridor_max)
+{
+    uint16_t at = start;
+    size_t len = 0;
+
+    if (field->cost[start] == INFINITY)
+        return 0;
+
+    for (;;) {
+        if (len < corridor_max)
+            corridor[len] = at;
+        len ++;
+        if (at == field->goal)
+            break;
+        at = field->next[at];
+        assert(len <= field->nodes_count);
+    }
+
+    return len;
+}
@@ -0,0 +1,43 @@
+#ifndef ENGINE_FLOWFIELD_H
+#define ENGINE_FLOWFIELD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "engine/path.h"
+#include "engine/trigraph.h"
+
+/* the way to one goal from everywhere at once, for crowds heading to the
+ * same place.  a single dijkstra out from the goal, backwards along every
+ * edge, leaves each trinode with its cost to the goal and the neighbour
+ * to step to, so an agent anywhere just follows next.
+ *
+ * when a cost changes, only what it touches is worked out again: a cheaper
+ * step spreads out from where it is, and a dearer step on some node's way
+ * to the goal clears everything whose way went through it and fills that
+ * back in from the nodes around it */
+
+struct flowfield {
+    size_t nodes_count;
+    uint16_t goal;
+    uint16_t *next;             /* INDEX_NULL at the goal, and where there's
+                                 * no way to it */
+    float *cost;                /* to the goal, INFINITY if there's no way */
+
+    struct path_scratch *scratch;
+    uint16_t *queue;            /* the nodes a dearer step cleared */
+    size_t expanded;            /* by the last build or update */
+};
+
+void flowfield_build(const struct trigraph *graph, uint16_t goal, struct flowfield *field);
+void flowfield_free(struct flowfield *field);
+
+/* for after graph->nodes[node].costs[edge] has changed */
+void flowfield_cost_changed(const struct trigraph *graph, struct flowfield *field,
+                            uint16_t node, unsigned edge);
+
+/* the nodes from start to the goal, as path_find would give them */
+size_t flowfield_corridor(const struct flowfield *field, uint16_t start,
+                          uint16_t *corridor, size_t corridor_max);
+
+#endif
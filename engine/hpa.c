@@ -0,0 +1,916 @@
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/mman.h>
+
+#include "engine/hpa.h"
+#include "engine/path.h"
+#include "engine/trifile.h"
+#include "engine/trigraph.h"
+
+/* an edge where two clusters meet, seen from the lower numbered one */
+struct hpa_border {
+    uint32_t clusters;          /* lower cluster << 16 | higher */
+    uint16_t node;              /* in the lower cluster */
+    uint16_t other;
+    uint16_t lo, hi;            /* vertices along the edge */
+    float x, y;                 /* its midpoint */
+};
+
+/* a border edge's place along its run */
+struct hpa_member {
+    uint32_t run;
+    uint32_t border;
+    float along;
+};
+
+static int border_cmp(const void *a, const void *b)
+{
+    const struct hpa_border *x = a, *y = b;
+
+    return (x->clusters > y->clusters) - (x->clusters < y->clusters);
+}
+
+static int member_cmp(const void *a, const void *b)
+{
+    const struct hpa_member *x = a, *y = b;
+
+    if (x->run != y->run) return (x->run > y->run) - (x->run < y->run);
+    return (x->along > y->along) - (x->along < y->along);
+}
+
+static int pair_cmp(const void *a, const void *b)
+{
+    const uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+
+    return (x > y) - (x < y);
+}
+
+static int index_cmp(const void *a, const void *b)
+{
+    const uint16_t x = *(const uint16_t *) a, y = *(const uint16_t *) b;
+
+    return (x > y) - (x < y);
+}
+
+static uint32_t pair_key(uint16_t a, uint16_t b)
+{
+    return a < b ? (uint32_t) a << 16 | b : (uint32_t) b << 16 | a;
+}
+
+static size_t cluster_end(const struct trigraph *graph, const struct hpa *hpa,
+                          size_t cluster)
+{
+    const size_t end = (cluster + 1) * hpa->cluster_nodes;
+
+    return end < graph->nodes_count ? end : graph->nodes_count;
+}
+
+static uint32_t union_find(uint32_t *runs, uint32_t i)
+{
+    while (runs[i] != i)
+        i = runs[i] = runs[runs[i]];
+    return i;
+}
+
+static void edges_ensure(struct hpa *hpa, size_t *edges_alloc)
+{
+    if (hpa->edges_count < *edges_alloc) return;
+
+    *edges_alloc = *edges_alloc ? 2 * *edges_alloc : 1024;
+    hpa->edges = realloc(hpa->edges, *edges_alloc * sizeof hpa->edges[0]);
+    assert(hpa->edges != NULL);
+}
+
+static void paths_ensure(struct hpa *hpa, size_t *paths_alloc, size_t more)
+{
+    if (hpa->paths_count + more <= *paths_alloc) return;
+
+    while (hpa->paths_count + more > *paths_alloc)
+        *paths_alloc = *paths_alloc ? 2 * *paths_alloc : 4096;
+    hpa->paths = realloc(hpa->paths, *paths_alloc * sizeof hpa->paths[0]);
+    assert(hpa->paths != NULL);
+}
+
+static void add_edge(struct hpa *hpa, size_t *edges_alloc, uint32_t to, float cost)
+{
+    struct hpa_edge *edge;
+
+    edges_ensure(hpa, edges_alloc);
+    edge = &hpa->edges[hpa->edges_count++];
+    edge->to = to;
+    edge->cost = cost;
+    edge->path = hpa->paths_count;
+    edge->path_len = 0;
+}
+
+/* labels each piece of the map nodes can walk between, whichever way */
+static void build_components(const struct trigraph *graph, struct hpa *hpa)
+{
+    uint16_t *stack;
+    size_t i, j, depth;
+
+    stack = malloc((graph->nodes_count + 1) * sizeof stack[0]);
+    assert(stack != NULL);
+
+    for (i = 0; i < graph->nodes_count; i++)
+        hpa->components[i] = INDEX_NULL;
+
+    for (i = 0; i < graph->nodes_count; i++) {
+        if (hpa->components[i] != INDEX_NULL) continue;
+
+        hpa->components[i] = hpa->components_count;
+        stack[0] = i;
+        depth = 1;
+
+        while (depth) {
+            const uint16_t id = stack[--depth];
+            const struct trinode *node = &graph->nodes[id];
+
+            for (j = 0; j < 3; j++) {
+                const uint16_t next = node->neighbours[j];
+                unsigned k;
+
+                if (next == INDEX_NULL || hpa->components[next] != INDEX_NULL)
+                    continue;
+
+                for (k = 0; k < 2 && graph->nodes[next].neighbours[k] != id; k++)
+                    ;
+                if (node->costs[j] == COST_BLOCKED
+                    && graph->nodes[next].costs[k] == COST_BLOCKED)
+                    continue;
+
+                hpa->components[next] = hpa->components_count;
+                stack[depth++] = next;
+            }
+        }
+
+        hpa->components_count ++;
+    }
+
+    free(stack);
+}
+
+/* every edge between clusters that can be crossed at least one way */
+static struct hpa_border *build_borders(const struct trigraph *graph,
+                                        const struct hpa *hpa, size_t *count)
+{
+    struct hpa_border *borders;
+    size_t i, j;
+
+    borders = malloc((3 * graph->nodes_count + 1) * sizeof borders[0]);
+    assert(borders != NULL);
+    *count = 0;
+
+    for (i = 0; i < graph->nodes_count; i++) {
+        const struct trinode *node = &graph->nodes[i];
+        const size_t cluster = i / hpa->cluster_nodes;
+
+        for (j = 0; j < 3; j++) {
+            const uint16_t other = node->neighbours[j];
+            const struct vertex *a = &graph->vertices[node->vertices[j]];
+            const struct vertex *b = &graph->vertices[node->vertices[(j + 1) % 3]];
+            struct hpa_border *border;
+            unsigned k;
+
+            if (other == INDEX_NULL || other / hpa->cluster_nodes <= cluster)
+                continue;
+
+            for (k = 0; k < 2 && graph->nodes[other].neighbours[k] != i; k++)
+                ;
+            if (node->costs[j] == COST_BLOCKED
+                && graph->nodes[other].costs[k] == COST_BLOCKED)
+                continue;
+
+            border = &borders[(*count)++];
+            border->clusters = (uint32_t) cluster << 16 | other / hpa->cluster_nodes;
+            border->node = i;
+            border->other = other;
+            border->lo = node->vertices[j];
+            border->hi = node->vertices[(j + 1) % 3];
+            border->x = (a->x + b->x) / 2;
+            border->y = (a->y + b->y) / 2;
+        }
+    }
+
+    qsort(borders, *count, sizeof borders[0], &border_cmp);
+    return borders;
+}
+
+/* splits the edges between each pair of clusters into runs that touch end
+ * to end, and picks the middle edge of a short run.  a longer one gets its
+ * two end edges, and what's between split into stretches of at most
+ * HPA_RUN_EDGES with the middle edge of each.  returns the picked edges as
+ * pair_key()s, sorted */
+static uint32_t *build_entrances(const struct hpa_border *borders, size_t count,
+                                 size_t *entrances_count)
+{
+    struct hpa_member *members;
+    uint32_t *runs, *entrances;
+    float *min_x, *min_y, *max_x, *max_y;
+    size_t i, j, k, l, m;
+
+    runs = malloc((count + 1) * sizeof runs[0]);
+    members = malloc((count + 1) * sizeof members[0]);
+    entrances = malloc((count + 1) * sizeof entrances[0]);
+    min_x = malloc((count + 1) * sizeof min_x[0]);
+    min_y = malloc((count + 1) * sizeof min_y[0]);
+    max_x = malloc((count + 1) * sizeof max_x[0]);
+    max_y = malloc((count + 1) * sizeof max_y[0]);
+    assert(runs != NULL && members != NULL && entrances != NULL && min_x != NULL
+           && min_y != NULL && max_x != NULL && max_y != NULL);
+
+    *entrances_count = 0;
+
+    for (i = 0; i < count; i = j) {
+        for (j = i + 1; j < count && borders[j].clusters == borders[i].clusters; j++)
+            ;
+
+        for (k = i; k < j; k++) {
+            runs[k] = k;
+            min_x[k] = min_y[k] = INFINITY;
+            max_x[k] = max_y[k] = -INFINITY;
+        }
+
+        for (k = i; k < j; k++) {
+            for (l = k + 1; l < j; l++) {
+                if (borders[k].lo == borders[l].lo || borders[k].lo == borders[l].hi
+                    || borders[k].hi == borders[l].lo || borders[k].hi == borders[l].hi)
+                    runs[union_find(runs, k)] = union_find(runs, l);
+            }
+        }
+
+        for (k = i; k < j; k++) {
+            const uint32_t run = union_find(runs, k);
+
+            if (borders[k].x < min_x[run]) min_x[run] = borders[k].x;
+            if (borders[k].y < min_y[run]) min_y[run] = borders[k].y;
+            if (borders[k].x > max_x[run]) max_x[run] = borders[k].x;
+            if (borders[k].y > max_y[run]) max_y[run] = borders[k].y;
+        }
+
+        /* each run in order along whichever way it's longer */
+        for (k = i; k < j; k++) {
+            const uint32_t run = union_find(runs, k);
+
+            members[k].run = run;
+            members[k].border = k;
+            members[k].along = (max_x[run] - min_x[run] > max_y[run] - min_y[run])
+                             ? borders[k].x : borders[k].y;
+        }
+        qsort(members + i, j - i, sizeof members[0], &member_cmp);
+
+        for (k = i; k < j; k = l) {
+            const struct hpa_border *first, *last;
+            size_t stretches, n;
+
+            for (l = k + 1; l < j && members[l].run == members[k].run; l++)
+                ;
+
+            n = l - k;
+            if (n <= HPA_RUN_ENDS) {
+                const struct hpa_border *border = &borders[members[k + n / 2].border];
+
+                entrances[(*entrances_count)++] = pair_key(border->node, border->other);
+                continue;
+            }
+
+            /* a way hugging either end of a long run mustn't have to go
+             * round by its middle, so those both get one */
+            first = &borders[members[k].border];
+            last = &borders[members[l - 1].border];
+            entrances[(*entrances_count)++] = pair_key(first->node, first->other);
+            entrances[(*entrances_count)++] = pair_key(last->node, last->other);
+
+            n -= 2;
+            stretches = (n + HPA_RUN_EDGES - 1) / HPA_RUN_EDGES;
+            for (m = 0; m < stretches; m++) {
+                const size_t lo = k + 1 + m * n / stretches;
+                const size_t hi = k + 1 + (m + 1) * n / stretches;
+                const struct hpa_border *border = &borders[members[(lo + hi) / 2].border];
+
+                entrances[(*entrances_count)++] = pair_key(border->node, border->other);
+            }
+        }
+    }
+
+    qsort(entrances, *entrances_count, sizeof entrances[0], &pair_cmp);
+
+    free(runs);
+    free(members);
+    free(min_x);
+    free(min_y);
+    free(max_x);
+    free(max_y);
+    return entrances;
+}
+
+/* builds the hierarchy for a trigraph from scratch, using its costs as
+ * they stand.  fails if there would be too many entrances for the search
+ * to index, which bigger clusters will fix */
+int hpa_build(const struct trigraph *graph, uint32_t cluster_nodes, struct hpa *hpa)
+{
+    struct path_scratch *scratch;
+    struct hpa_border *borders;
+    uint32_t *entrances;
+    size_t borders_count, entrances_count, edges_alloc = 0, paths_alloc = 0, i, j, k;
+
+    memset(hpa, 0, sizeof *hpa);
+    assert(cluster_nodes > 0);
+
+    hpa->cluster_nodes = cluster_nodes;
+    hpa->clusters_count = (graph->nodes_count + cluster_nodes - 1) / cluster_nodes;
+    if (hpa->clusters_count > INDEX_NULL) {
+        fprintf(stderr, "hpa: clusters of %u nodes are too small\n", cluster_nodes);
+        return -1;
+    }
+
+    hpa->components = malloc((graph->nodes_count + 1) * sizeof hpa->components[0]);
+    assert(hpa->components != NULL);
+    build_components(graph, hpa);
+
+    borders = build_borders(graph, hpa, &borders_count);
+    entrances = build_entrances(borders, borders_count, &entrances_count);
+    free(borders);
+
+    /* both sides of each entrance, once each, in order */
+    hpa->abstract = malloc((2 * entrances_count + 1) * sizeof hpa->abstract[0]);
+    assert(hpa->abstract != NULL);
+    for (i = 0; i < entrances_count; i++) {
+        hpa->abstract[2 * i] = entrances[i] >> 16;
+        hpa->abstract[2 * i + 1] = entrances[i] & 0xffff;
+    }
+    qsort(hpa->abstract, 2 * entrances_count, sizeof hpa->abstract[0], &index_cmp);
+    for (i = j = 0; i < 2 * entrances_count; i++) {
+        if (j == 0 || hpa->abstract[j - 1] != hpa->abstract[i])
+            hpa->abstract[j++] = hpa->abstract[i];
+    }
+    hpa->abstract_count = j;
+
+    if (hpa->abstract_count + 1 >= INDEX_NULL) {
+        fprintf(stderr, "hpa: %zu entrances is too many, try bigger clusters "
+                "than %u nodes\n", hpa->abstract_count, cluster_nodes);
+        free(entrances);
+        hpa_free(hpa);
+        return -1;
+    }
+
+    hpa->cluster_first = malloc((hpa->clusters_count + 1) * sizeof hpa->cluster_first[0]);
+    hpa->edge_first = malloc((hpa->abstract_count + 1) * sizeof hpa->edge_first[0]);
+    assert(hpa->cluster_first != NULL && hpa->edge_first != NULL);
+
+    for (i = j = 0; i <= hpa->clusters_count; i++) {
+        while (j < hpa->abstract_count && hpa->abstract[j] / cluster_nodes < i)
+            j ++;
+        hpa->cluster_first[i] = j;
+    }
+
+    scratch = path_scratch_new(graph);
+
+    for (i = 0; i < hpa->clusters_count; i++) {
+        const size_t first = i * cluster_nodes, last = cluster_end(graph, hpa, i);
+
+        for (j = hpa->cluster_first[i]; j < hpa->cluster_first[i + 1]; j++) {
+            const uint16_t id = hpa->abstract[j];
+            const struct trinode *node = &graph->nodes[id];
+
+            hpa->edge_first[j] = hpa->edges_count;
+
+            /* to the cluster's other entrances, through it */
+            path_flood(graph, scratch, id, first, last, 0);
+            for (k = hpa->cluster_first[i]; k < hpa->cluster_first[i + 1]; k++) {
+                const struct path_node *n = &scratch->nodes[hpa->abstract[k]];
+                struct hpa_edge *edge;
+                uint16_t step;
+                size_t len;
+
+                if (k == j || n->stamp != scratch->generation) continue;
+
+                add_edge(hpa, &edges_alloc, k, n->g);
+                edge = &hpa->edges[hpa->edges_count - 1];
+
+                for (step = n->parent; step != id; step = scratch->nodes[step].parent)
+                    edge->path_len ++;
+                paths_ensure(hpa, &paths_alloc, edge->path_len);
+                len = edge->path_len;
+                for (step = n->parent; step != id; step = scratch->nodes[step].parent)
+                    hpa->paths[edge->path + --len] = step;
+                hpa->paths_count += edge->path_len;
+            }
+
+            /* and across to the other side of its entrances */
+            for (k = 0; k < 3; k++) {
+                const uint16_t other = node->neighbours[k];
+                const float step = path_step(scratch, graph, id, k);
+                const uint32_t key = pair_key(id, other);
+                uint16_t *to;
+
+                if (step < 0 || other / cluster_nodes == i
+                    || !bsearch(&key, entrances, entrances_count,
+                                sizeof entrances[0], &pair_cmp))
+                    continue;
+
+                to = bsearch(&other, hpa->abstract, hpa->abstract_count,
+                             sizeof hpa->abstract[0], &index_cmp);
+                assert(to != NULL);
+
+                add_edge(hpa, &edges_alloc, to - hpa->abstract, step);
+            }
+        }
+    }
+    hpa->edge_first[hpa->abstract_count] = hpa->edges_count;
+
+    path_scratch_free(scratch);
+    free(entrances);
+    return 0;
+}
+
+int hpa_write(const char *filename, const struct trigraph *graph, const struct hpa *hpa)
+{
+    struct trifile_blob blobs[7];
+    struct hpa_params params;
+
+    memset(&params, 0, sizeof params);
+    params.base_check = graph->check;
+    params.cluster_nodes = hpa->cluster_nodes;
+    params.clusters_count = hpa->clusters_count;
+    params.abstract_count = hpa->abstract_count;
+    params.edges_count = hpa->edges_count;
+    params.components_count = hpa->components_count;
+    params.paths_count = hpa->paths_count;
+
+    blobs[0].tag = HPA_PARAMS;
+    blobs[0].data = &params;
+    blobs[0].size = sizeof params;
+    blobs[1].tag = HPA_ABSTRACT;
+    blobs[1].data = hpa->abstract;
+    blobs[1].size = hpa->abstract_count * sizeof hpa->abstract[0];
+    blobs[2].tag = HPA_CLUSTERS;
+    blobs[2].data = hpa->cluster_first;
+    blobs[2].size = (hpa->clusters_count + 1) * sizeof hpa->cluster_first[0];
+    blobs[3].tag = HPA_EDGE_FIRST;
+    blobs[3].data = hpa->edge_first;
+    blobs[3].size = (hpa->abstract_count + 1) * sizeof hpa->edge_first[0];
+    blobs[4].tag = HPA_EDGES;
+    blobs[4].data = hpa->edges;
+    blobs[4].size = hpa->edges_count * sizeof hpa->edges[0];
+    blobs[5].tag = HPA_COMPONENTS;
+    blobs[5].data = hpa->components;
+    blobs[5].size = graph->nodes_count * sizeof hpa->components[0];
+    blobs[6].tag = HPA_PATHS;
+    blobs[6].data = hpa->paths;
+    blobs[6].size = hpa->paths_count * sizeof hpa->paths[0];
+
+    return trifile_write(filename, graph->nodes_count, graph->vertices_count,
+                         blobs, 7, NULL);
+}
+
+static const char *hpa_section(const struct trifile *file, uint32_t tag,
+                               void **data, size_t size)
+{
+    const char *error;
+    size_t found;
+
+    if ((error = trifile_section(file, tag, data, &found)))
+        return error;
+    if (found != size)
+        return "section size doesn't match its count";
+    return NULL;
+}
+
+/* everything the search will take on trust later */
+static const char *validate(const struct trigraph *graph, const struct hpa *hpa)
+{
+    size_t i, j;
+
+    for (i = 0; i < hpa->abstract_count; i++) {
+        if (hpa->abstract[i] >= graph->nodes_count
+            || (i > 0 && hpa->abstract[i] <= hpa->abstract[i - 1]))
+            return "entrances out of order";
+    }
+
+    if (hpa->cluster_first[0] != 0
+        || hpa->cluster_first[hpa->clusters_count] != hpa->abstract_count)
+        return "clusters don't cover the entrances";
+    for (i = 0; i < hpa->clusters_count; i++) {
+        if (hpa->cluster_first[i] > hpa->cluster_first[i + 1])
+            return "clusters out of order";
+        for (j = hpa->cluster_first[i]; j < hpa->cluster_first[i + 1]; j++) {
+            if (hpa->abstract[j] / hpa->cluster_nodes != i)
+                return "entrance in the wrong cluster";
+        }
+    }
+
+    if (hpa->edge_first[0] != 0
+        || hpa->edge_first[hpa->abstract_count] != hpa->edges_count)
+        return "edges don't cover the entrances";
+    for (i = 0; i < hpa->abstract_count; i++) {
+        if (hpa->edge_first[i] > hpa->edge_first[i + 1])
+            return "edges out of order";
+    }
+    for (i = 0; i < hpa->abstract_count; i++) {
+        for (j = hpa->edge_first[i]; j < hpa->edge_first[i + 1]; j++) {
+            const struct hpa_edge *edge = &hpa->edges[j];
+            uint16_t from = hpa->abstract[i], to;
+            size_t k;
+
+            if (edge->to >= hpa->abstract_count
+                || !(edge->cost >= 0) || isinf(edge->cost))
+                return "bad edge";
+            if (edge->path > hpa->paths_count
+                || edge->path_len > hpa->paths_count - edge->path)
+                return "edge path out of range";
+
+            /* every step of the way has to be between neighbours */
+            for (k = 0; k <= edge->path_len; k++) {
+                const struct trinode *node = &graph->nodes[from];
+
+                to = (k < edge->path_len) ? hpa->paths[edge->path + k]
+                                          : hpa->abstract[edge->to];
+                if (to >= graph->nodes_count
+                    || (node->neighbours[0] != to && node->neighbours[1] != to
+                        && node->neighbours[2] != to))
+                    return "edge path isn't connected";
+                from = to;
+            }
+        }
+    }
+
+    for (i = 0; i < graph->nodes_count; i++) {
+        if (hpa->components[i] >= hpa->components_count)
+            return "bad component";
+    }
+
+    return NULL;
+}
+
+static const char *hpa_apply(const struct trifile *file, const struct trigraph *graph,
+                             struct hpa *hpa)
+{
+    struct hpa_params *params;
+    const char *error;
+    void *data;
+
+    if (file->header.nodes_count != graph->nodes_count
+        || file->header.vertices_count != graph->vertices_count)
+        return "made for a different trigraph";
+
+    if ((error = hpa_section(file, HPA_PARAMS, &data, sizeof *params)))
+        return error;
+    params = data;
+
+    if (params->base_check != graph->check)
+        return "made for a different trigraph";
+    if (params->cluster_nodes == 0
+        || params->clusters_count
+            != (graph->nodes_count + params->cluster_nodes - 1) / params->cluster_nodes
+        || params->abstract_count + 1 >= INDEX_NULL
+        || params->components_count > graph->nodes_count)
+        return "bad parameters";
+
+    hpa->cluster_nodes = params->cluster_nodes;
+    hpa->clusters_count = params->clusters_count;
+    hpa->abstract_count = params->abstract_count;
+    hpa->edges_count = params->edges_count;
+    hpa->components_count = params->components_count;
+    hpa->paths_count = params->paths_count;
+
+    if ((error = hpa_section(file, HPA_ABSTRACT, &data,
+                             hpa->abstract_count * sizeof hpa->abstract[0])))
+        return error;
+    hpa->abstract = data;
+    if ((error = hpa_section(file, HPA_CLUSTERS, &data,
+                             (hpa->clusters_count + 1) * sizeof hpa->cluster_first[0])))
+        return error;
+    hpa->cluster_first = data;
+    if ((error = hpa_section(file, HPA_EDGE_FIRST, &data,
+                             (hpa->abstract_count + 1) * sizeof hpa->edge_first[0])))
+        return error;
+    hpa->edge_first = data;
+    if ((error = hpa_section(file, HPA_EDGES, &data,
+                             hpa->edges_count * sizeof hpa->edges[0])))
+        return error;
+    hpa->edges = data;
+    if ((error = hpa_section(file, HPA_COMPONENTS, &data,
+                             graph->nodes_count * sizeof hpa->components[0])))
+        return error;
+    hpa->components = data;
+    if ((error = hpa_section(file, HPA_PATHS, &data,
+                             hpa->paths_count * sizeof hpa->paths[0])))
+        return error;
+    hpa->paths = data;
+
+    return validate(graph, hpa);
+}
+
+/* maps the hierarchy mapc baked alongside a trigraph.  returns -1 (having
+ * said why) if it's no good, or was baked from some other trigraph */
+int hpa_load(const char *filename, const struct trigraph *graph, struct hpa *hpa)
+{
+    struct trifile file;
+    const char *error;
+
+    memset(hpa, 0, sizeof *hpa);
+
+    if (trifile_open(filename, &file) < 0)
+        return -1;
+
+    hpa->file = file.data;
+    hpa->file_size = file.size;
+
+    error = hpa_apply(&file, graph, hpa);
+    if (error) {
+        fprintf(stderr, "%s: %s\n", filename, error);
+        hpa_free(hpa);
+        return -1;
+    }
+
+    return 0;
+}
+
+void hpa_free(struct hpa *hpa)
+{
+    if (hpa->file) {
+        munmap(hpa->file, hpa->file_size);
+    }
+    else {
+        free(hpa->abstract);
+        free(hpa->cluster_first);
+        free(hpa->edge_first);
+        free(hpa->edges);
+        free(hpa->components);
+        free(hpa->paths);
+    }
+    memset(hpa, 0, sizeof *hpa);
+}
+
+struct hpa_scratch *hpa_scratch_new(const struct trigraph *graph, const struct hpa *hpa)
+{
+    struct hpa_scratch *scratch;
+    double area = 0;
+    size_t i;
+
+    scratch = malloc(sizeof *scratch);
+    assert(scratch != NULL);
+
+    scratch->nodes = path_scratch_new(graph);
+    scratch->abstract = path_scratch_alloc(hpa->abstract_count + 1);
+    scratch->route = malloc((hpa->abstract_count + 1) * sizeof scratch->route[0]);
+    assert(scratch->route != NULL);
+
+    scratch->cluster_max = 0;
+    for (i = 0; i < hpa->clusters_count; i++) {
+        const size_t n = hpa->cluster_first[i + 1] - hpa->cluster_first[i];
+
+        if (n > scratch->cluster_max) scratch->cluster_max = n;
+    }
+
+    scratch->start_costs = malloc((scratch->cluster_max + 1) * sizeof scratch->start_costs[0]);
+    scratch->goal_costs = malloc((scratch->cluster_max + 1) * sizeof scratch->goal_costs[0]);
+    assert(scratch->start_costs != NULL && scratch->goal_costs != NULL);
+    scratch->expanded = 0;
+
+    /* about three clusters across, inside which the hpa's detours through
+     * entrances cost more than a* saves */
+    for (i = 0; i < graph->nodes_count; i++) {
+        const struct trinode *node = &graph->nodes[i];
+        const struct vertex *a = &graph->vertices[node->vertices[0]];
+        const struct vertex *b = &graph->vertices[node->vertices[1]];
+        const struct vertex *c = &graph->vertices[node->vertices[2]];
+
+        area += ((double) (b->x - a->x) * (c->y - a->y)
+                 - (double) (b->y - a->y) * (c->x - a->x)) / 2;
+    }
+    scratch->near = hpa->clusters_count ? 3 * sqrt(area / hpa->clusters_count) : 0;
+
+    return scratch;
+}
+
+void hpa_scratch_free(struct hpa_scratch *scratch)
+{
+    if (!scratch) return;
+
+    path_scratch_free(scratch->nodes);
+    path_scratch_free(scratch->abstract);
+    free(scratch->route);
+    free(scratch->start_costs);
+    free(scratch->goal_costs);
+    free(scratch);
+}
+
+/* the cost of the cheapest way between a node and each entrance of its
+ * cluster, or -1 where there's none */
+static void hpa_entrance_costs(const struct trigraph *graph, const struct hpa *hpa,
+                               struct hpa_scratch *scratch, uint16_t id,
+                               int reverse, float *costs)
+{
+    const size_t cluster = id / hpa->cluster_nodes;
+    const struct path_node *nodes = scratch->nodes->nodes;
+    size_t i;
+
+    path_flood(graph, scratch->nodes, id, cluster * hpa->cluster_nodes,
+               cluster_end(graph, hpa, cluster), reverse);
+    scratch->expanded += scratch->nodes->expanded;
+
+    for (i = hpa->cluster_first[cluster]; i < hpa->cluster_first[cluster + 1]; i++) {
+        const struct path_node *n = &nodes[hpa->abstract[i]];
+
+        costs[i - hpa->cluster_first[cluster]] =
+            (n->stamp == scratch->nodes->generation) ? n->g : -1;
+    }
+}
+
+/* a* over the entrances, from those the start can reach to the goal.
+ * returns how many entrances the route passes through, or 0 if none */
+static size_t hpa_route(const struct hpa *hpa, struct hpa_scratch *scratch,
+                        uint16_t start, uint16_t goal)
+{
+    struct path_scratch *search = scratch->abstract;
+    const struct vertex *centroids = scratch->nodes->centroids;
+    const struct vertex *target = &centroids[goal];
+    const uint16_t finish = hpa->abstract_count;
+    const size_t cs = start / hpa->cluster_nodes, cg = goal / hpa->cluster_nodes;
+    struct path_node *nodes = search->nodes;
+    size_t len = 0, i;
+    uint32_t gen;
+    uint16_t id;
+
+    gen = path_begin(search);
+
+    for (i = hpa->cluster_first[cs]; i < hpa->cluster_first[cs + 1]; i++) {
+        const float g = scratch->start_costs[i - hpa->cluster_first[cs]];
+        const struct vertex *here = &centroids[hpa->abstract[i]];
+
+        if (g < 0) continue;
+
+        nodes[i].stamp = gen;
+        nodes[i].g = g;
+        nodes[i].parent = INDEX_NULL;
+        path_open_push(search, i,
+                       g + hypotf(target->x - here->x, target->y - here->y));
+    }
+
+    while (search->open_count) {
+        const uint16_t current = path_open_pop(search);
+        const size_t cluster = hpa->abstract[current] / hpa->cluster_nodes;
+        uint32_t e;
+
+        search->expanded ++;
+
+        if (current == finish) break;
+
+        for (e = hpa->edge_first[current]; e <= hpa->edge_first[current + 1]; e++) {
+            uint16_t next;
+            struct path_node *n;
+            float g, h;
+
+            /* one past the last edge is the way out to the goal, if
+             * there is one from here */
+            if (e < hpa->edge_first[current + 1]) {
+                const struct vertex *there;
+
+                next = hpa->edges[e].to;
+                g = nodes[current].g + hpa->edges[e].cost;
+                there = &centroids[hpa->abstract[next]];
+                h = hypotf(target->x - there->x, target->y - there->y);
+            }
+            else {
+                float rest;
+
+                if (cluster != cg) break;
+                rest = scratch->goal_costs[current - hpa->cluster_first[cg]];
+                if (rest < 0) break;
+
+                next = finish;
+                g = nodes[current].g + rest;
+                h = 0;
+            }
+
+            n = &nodes[next];
+            if (n->stamp != gen) {
+                n->stamp = gen;
+                n->g = g;
+                n->parent = current;
+                path_open_push(search, next, g + h);
+            }
+            else if (n->heap != PATH_CLOSED && g < n->g) {
+                n->g = g;
+                n->parent = current;
+                path_open_update(search, next, g + h);
+            }
+        }
+    }
+
+    scratch->expanded += search->expanded;
+
+    if (nodes[finish].stamp != gen || nodes[finish].heap != PATH_CLOSED)
+        return 0;
+
+    for (id = nodes[finish].parent; id != INDEX_NULL; id = nodes[id].parent)
+        len ++;
+    i = len;
+    for (id = nodes[finish].parent; id != INDEX_NULL; id = nodes[id].parent)
+        scratch->route[--i] = id;
+
+    return len;
+}
+
+static void hpa_append(uint16_t *corridor, size_t corridor_max, size_t *len,
+                       uint16_t id)
+{
+    if (*len < corridor_max)
+        corridor[*len] = id;
+    (*len) ++;
+}
+
+/* adds the path inside a cluster from the corridor's last node so far to
+ * another node.  returns the corridor's new length, or 0 if there's no
+ * such path any more */
+static size_t hpa_segment(const struct trigraph *graph, const struct hpa *hpa,
+                          struct hpa_scratch *scratch, uint16_t from, uint16_t to,
+                          uint16_t *corridor, size_t corridor_max, size_t len,
+                          float *total)
+{
+    const size_t cluster = from / hpa->cluster_nodes;
+    const size_t at = len ? len - 1 : 0;
+    size_t n;
+    float cost;
+
+    n = path_find_within(graph, scratch->nodes, from, to,
+                         cluster * hpa->cluster_nodes, cluster_end(graph, hpa, cluster),
+                         at < corridor_max ? corridor + at : corridor,
+                         at < corridor_max ? corridor_max - at : 0, &cost);
+    scratch->expanded += scratch->nodes->expanded;
+    if (!n) return 0;
+
+    *total += cost;
+    return at + n;
+}
+
+/* as path_find, but searching the entrances first, then filling in the
+ * way from the start to the first and from the last to the goal.  the
+ * result is usually close to the cheapest, but not always.  the hierarchy
+ * keeps the costs it was built with, so rebuild it after changing them */
+size_t hpa_find(const struct trigraph *graph, const struct hpa *hpa,
+                struct hpa_scratch *scratch, uint16_t start, uint16_t goal,
+                uint16_t *corridor, size_t corridor_max, float *cost)
+{
+    const struct vertex *centroids = scratch->nodes->centroids;
+    size_t route_len, len, i, j;
+    float total = 0;
+
+    assert(start < graph->nodes_count && goal < graph->nodes_count);
+
+    scratch->expanded = 0;
+
+    if (hpa->components[start] != hpa->components[goal])
+        return 0;
+    if (start / hpa->cluster_nodes == goal / hpa->cluster_nodes
+        || hypotf(centroids[goal].x - centroids[start].x,
+                  centroids[goal].y - centroids[start].y) < scratch->near)
+        goto flat;
+
+    hpa_entrance_costs(graph, hpa, scratch, start, 0, scratch->start_costs);
+    hpa_entrance_costs(graph, hpa, scratch, goal, 1, scratch->goal_costs);
+
+    route_len = hpa_route(hpa, scratch, start, goal);
+    if (!route_len) goto flat;
+
+    len = hpa_segment(graph, hpa, scratch, start, hpa->abstract[scratch->route[0]],
+                      corridor, corridor_max, 0, &total);
+    if (!len) goto flat;
+
+    for (i = 0; i + 1 < route_len; i++) {
+        const uint16_t from = scratch->route[i], to = scratch->route[i + 1];
+        const struct hpa_edge *edge = NULL;
+        uint32_t e;
+
+        for (e = hpa->edge_first[from]; e < hpa->edge_first[from + 1]; e++) {
+            if (hpa->edges[e].to == to) {
+                edge = &hpa->edges[e];
+                break;
+            }
+        }
+        assert(edge != NULL);
+
+        for (j = 0; j < edge->path_len; j++)
+            hpa_append(corridor, corridor_max, &len, hpa->paths[edge->path + j]);
+        hpa_append(corridor, corridor_max, &len, hpa->abstract[to]);
+        total += edge->cost;
+    }
+
+    len = hpa_segment(graph, hpa, scratch, hpa->abstract[scratch->route[route_len - 1]],
+                      goal, corridor, corridor_max, len, &total);
+    if (!len) goto flat;
+
+    if (cost) *cost = total;
+    return len;
+
+flat:
+    len = path_find(graph, scratch->nodes, start, goal, corridor, corridor_max, cost);
+    scratch->expanded += scratch->nodes->expanded;
+    return len;
+}
@@ -0,0 +1,115 @@
+#ifndef ENGINE_HPA_H
+#define ENGINE_HPA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "engine/path.h"
+#include "engine/trifile.h"
+#include "engine/trigraph.h"
+
+/* a hierarchy over a trigraph, for long queries.  trinodes are split into
+ * clusters of cluster_nodes in a row: mapc numbers nodes in morton order,
+ * so a run of them covers a compact patch of map.  where two clusters
+ * meet along a run of edges, the nodes either side of its middle edge are
+ * entrances, or for a run of more than HPA_RUN_ENDS, those at either end
+ * and at the middle of every HPA_RUN_EDGES between.  the abstract graph
+ * joins entrances across their edge, and to every other entrance of the
+ * same cluster at the cost of the cheapest path between them inside it,
+ * which is kept too.
+ *
+ * the paths aren't always the cheapest.  over pathbench's random queries
+ * on maps of 13k to 65k nodes, they cost 1-4% more than a*'s on average,
+ * 10-15% more at the 99th percentile, and as much as a third more at the
+ * worst of 2000.  queries closer than about three clusters across are left
+ * to plain a*, so are exact, and on a map of only a few clusters that's
+ * all of them.  it answers 2-4x as many queries as a* at 13k-20k nodes,
+ * and 4-9x at 50k-65k.
+ *
+ * baked next to the trigraph as map.hpa, a trifile with sections:
+ *   HPA_PARAMS         struct hpa_params
+ *   HPA_ABSTRACT       uint16_t[abstract_count], the trinode of each
+ *                      entrance, in order (so grouped by cluster)
+ *   HPA_CLUSTERS       uint32_t[clusters_count + 1], each cluster's first
+ *                      entrance
+ *   HPA_EDGE_FIRST     uint32_t[abstract_count + 1], each entrance's first
+ *                      edge
+ *   HPA_EDGES          struct hpa_edge[edges_count]
+ *   HPA_PATHS          uint16_t[paths_count], the trinodes each edge
+ *                      passes through on the way
+ *   HPA_COMPONENTS     uint16_t[nodes_count], which connected piece of the
+ *                      map each trinode is in
+ */
+#define HPA_PARAMS          TRIFILE_TAG('H','P','A','P')
+#define HPA_ABSTRACT        TRIFILE_TAG('H','P','A','N')
+#define HPA_CLUSTERS        TRIFILE_TAG('H','P','A','C')
+#define HPA_EDGE_FIRST      TRIFILE_TAG('H','P','A','F')
+#define HPA_EDGES           TRIFILE_TAG('H','P','A','E')
+#define HPA_COMPONENTS      TRIFILE_TAG('H','P','A','K')
+#define HPA_PATHS           TRIFILE_TAG('H','P','A','W')
+
+#define HPA_CLUSTER_NODES   (512)
+#define HPA_RUN_EDGES       (16)    /* the most between two entrances */
+#define HPA_RUN_ENDS        (5)     /* runs longer get one at either end */
+
+struct hpa_params {
+    uint32_t base_check;        /* header_check of the trigraph file */
+    uint32_t cluster_nodes;
+    uint32_t clusters_count;
+    uint32_t abstract_count;
+    uint32_t edges_count;
+    uint32_t components_count;
+    uint32_t paths_count;
+};
+
+struct hpa_edge {
+    uint32_t to;
+    float cost;
+    uint32_t path;              /* first trinode between the ends in HPA_PATHS */
+    uint32_t path_len;
+};
+
+struct hpa {
+    uint32_t cluster_nodes;
+    size_t clusters_count;
+    size_t abstract_count;
+    size_t edges_count;
+    size_t components_count;
+    size_t paths_count;
+    uint16_t *abstract;
+    uint32_t *cluster_first;
+    uint32_t *edge_first;
+    struct hpa_edge *edges;
+    uint16_t *components;
+    uint16_t *paths;
+
+    void *file;                 /* the mapping everything points into, if any */
+    size_t file_size;
+};
+
+/* per thread, as with struct path_scratch */
+struct hpa_scratch {
+    struct path_scratch *nodes;
+    struct path_scratch *abstract;  /* with the goal as one extra node */
+    uint16_t *route;            /* entrances on the way, in order */
+    float *start_costs;         /* to each entrance of the start's cluster */
+    float *goal_costs;          /* from each entrance of the goal's cluster */
+    size_t cluster_max;         /* the most entrances any cluster has */
+    float near;                 /* closer than this, plain a* is quicker */
+
+    size_t expanded;            /* by the last query, at every level */
+};
+
+int hpa_build(const struct trigraph *graph, uint32_t cluster_nodes, struct hpa *hpa);
+int hpa_write(const char *filename, const struct trigraph *graph, const struct hpa *hpa);
+int hpa_load(const char *filename, const struct trigraph *graph, struct hpa *hpa);
+void hpa_free(struct hpa *hpa);
+
+struct hpa_scratch *hpa_scratch_new(const struct trigraph *graph, const struct hpa *hpa);
+void hpa_scratch_free(struct hpa_scratch *scratch);
+
+size_t hpa_find(const struct trigraph *graph, const struct hpa *hpa,
+                struct hpa_scratch *scratch, uint16_t start, uint16_t goal,
+                uint16_t *corridor, size_t corridor_max, float *cost);
+
+#endif
@@ -1,38 +1,292 @@
 #include <config.h>
 
+#include <assert.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 #include <SDL.h>
 
-int main(int argc __attribute__((unused)),
-         char **argv __attribute__((unused)))
+#include "engine/ch.h"
+#include "engine/hpa.h"
+#include "engine/path.h"
+#include "engine/pathcache.h"
+#include "engine/trifile.h"
+#include "engine/trigraph.h"
+
+#define CORRIDOR_MAX (INDEX_NULL + 1)
+
+/* corridors remembered between queries, and their nodes between them */
+#define CACHE_ENTRIES       (1024)
+#define CACHE_NODES         (256 * 1024)
+
+/* fits the map's bounds to the window, keeping its aspect */
+struct view {
+    float min_x, min_y;
+    float scale;
+    int x0, y0;
+};
+
+static void view_fit(struct view *view, const struct trigraph *graph,
+                     int width, int height)
+{
+    float max_x, max_y, sx, sy;
+    size_t i;
+
+    view->min_x = view->min_y = max_x = max_y = 0;
+    for (i = 0; i < graph->vertices_count; i++) {
+        const struct vertex *v = &graph->vertices[i];
+
+        if (i == 0 || v->x < view->min_x) view->min_x = v->x;
+        if (i == 0 || v->y < view->min_y) view->min_y = v->y;
+        if (i == 0 || v->x > max_x) max_x = v->x;
+        if (i == 0 || v->y > max_y) max_y = v->y;
+    }
+
+    sx = (max_x > view->min_x) ? (width - 20) / (max_x - view->min_x) : 1;
+    sy = (max_y > view->min_y) ? (height - 20) / (max_y - view->min_y) : 1;
+    view->scale = sx < sy ? sx : sy;
+    view->x0 = (width - (max_x - view->min_x) * view->scale) / 2;
+    view->y0 = (height - (max_y - view->min_y) * view->scale) / 2;
+}
+
+static SDL_Point view_point(const struct view *view, const struct vertex *v)
+{
+    SDL_Point p;
+
+    p.x = view->x0 + (v->x - view->min_x) * view->scale;
+    p.y = view->y0 + (v->y - view->min_y) * view->scale;
+    return p;
+}
+
+static struct vertex view_unpoint(const struct view *view, int x, int y)
+{
+    struct vertex v;
+
+    v.x = view->min_x + (x - view->x0) / view->scale;
+    v.y = view->min_y + (y - view->y0) / view->scale;
+    return v;
+}
+
+/* each shared edge once, boundary edges brighter */
+static void draw_trigraph(SDL_Renderer *renderer, const struct trigraph *graph,
+                          const struct view *view)
+{
+    size_t i, j;
+
+    for (i = 0; i < graph->nodes_count; i++) {
+        const struct trinode *node = &graph->nodes[i];
+
+        for (j = 0; j < 3; j++) {
+            const uint16_t other = node->neighbours[j];
+            SDL_Point a, b;
+
+            if (other != INDEX_NULL && other < i) continue;
+
+            if (other == INDEX_NULL)
+                SDL_SetRenderDrawColor(renderer, 255, 0, 0, 255);
+            else
+                SDL_SetRenderDrawColor(renderer, 96, 0, 0, 255);
+
+            a = view_point(view, &graph->vertices[node->vertices[j]]);
+            b = view_point(view, &graph->vertices[node->vertices[(j + 1) % 3]]);
+            SDL_RenderDrawLine(renderer, a.x, a.y, b.x, b.y);
+        }
+    }
+}
+
+static void draw_path(SDL_Renderer *renderer, const struct view *view,
+                      const struct vertex *waypoints, size_t len)
+{
+    SDL_Point a, b;
+    size_t i;
+
+    SDL_SetRenderDrawColor(renderer, 255, 255, 0, 255);
+
+    a = view_point(view, &waypoints[0]);
+    for (i = 1; i < len; i++) {
+        b = view_point(view, &waypoints[i]);
+        SDL_RenderDrawLine(renderer, a.x, a.y, b.x, b.y);
+        a = b;
+    }
+}
+
+/* whatever pathfinding there is for the map loaded */
+struct search {
+    struct path_scratch *scratch;
+    struct hpa hpa;
+    struct hpa_scratch *hpa_scratch;    /* if it's loaded */
+    struct ch ch;
+    struct ch_scratch *ch_scratch;      /* if it's loaded */
+    struct pathcache *cache;
+};
+
+/* map.<extension> next to map.tri, or NULL if mapc didn't leave one */
+static char *companion(const char *filename, const char *extension)
+{
+    const char *dot = strrchr(filename, '.'), *slash = strrchr(filename, '/');
+    size_t len = strlen(filename);
+    char *name;
+
+    if (dot && (!slash || dot > slash))
+        len = dot - filename;
+
+    name = malloc(len + strlen(extension) + 1);
+    assert(name != NULL);
+    memcpy(name, filename, len);
+    strcpy(name + len, extension);
+
+    if (access(name, F_OK) != 0) {
+        free(name);
+        return NULL;
+    }
+    return name;
+}
+
+static void search_init(struct search *search, const char *filename,
+                        const struct trigraph *graph)
+{
+    char *name;
+
+    memset(search, 0, sizeof *search);
+    search->scratch = path_scratch_new(graph);
+    search->cache = pathcache_new(graph, CACHE_ENTRIES, CACHE_NODES);
+
+    /* the contraction hierarchy is exact and answers long queries faster
+     * than the hpa, so it's taken when mapc was asked for one (-C).  it's
+     * slow to bake, though, so by default there's only the hpa, whose paths
+     * can come out dearer than they need be */
+    name = companion(filename, ".ch");
+    if (name && ch_load(name, graph, &search->ch) == 0) {
+        fprintf(stderr, "using a contraction hierarchy with %zu shortcuts\n",
+                search->ch.shortcuts_count);
+        search->ch_scratch = ch_scratch_new(&search->ch);
+    }
+    free(name);
+    if (search->ch_scratch)
+        return;
+
+    name = companion(filename, ".hpa");
+    if (name && hpa_load(name, graph, &search->hpa) == 0) {
+        fprintf(stderr, "using a hierarchy of %zu clusters and %zu entrances\n",
+                search->hpa.clusters_count, search->hpa.abstract_count);
+        search->hpa_scratch = hpa_scratch_new(graph, &search->hpa);
+    }
+    free(name);
+}
+
+static void search_fini(struct search *search)
+{
+    struct pathcache_stats stats;
+
+    pathcache_stats(search->cache, &stats);
+    fprintf(stderr, "path cache: %zu of %zu lookups hit, %zu invalidated, "
+            "%zu evicted, %zu entries in %zuKB of %zuKB\n",
+            stats.hits, stats.lookups, stats.invalidated, stats.evicted,
+            stats.entries, stats.memory_used / 1024, stats.memory / 1024);
+
+    pathcache_free(search->cache);
+    path_scratch_free(search->scratch);
+    if (search->hpa_scratch) {
+        hpa_scratch_free(search->hpa_scratch);
+        hpa_free(&search->hpa);
+    }
+    if (search->ch_scratch) {
+        ch_scratch_free(search->ch_scratch);
+        ch_free(&search->ch);
+    }
+}
+
+/* between the nodes under two points, from the cache or else through a
+ * hierarchy if there is one.  points off the mesh are moved onto the
+ * nearest node first.  returns the corridor's length, 0 if there's no way */
+static size_t find_corridor(const struct trigraph *graph, struct search *search,
+                            struct vertex *from, struct vertex *to,
+                            uint16_t *corridor, size_t *expanded)
+{
+    const uint16_t start = trigraph_nearest(graph, from->x, from->y, from);
+    const uint16_t goal = trigraph_nearest(graph, to->x, to->y, to);
+    float cost = 0;
+    size_t len;
+
+    *expanded = 0;
+    if (start == INDEX_NULL || goal == INDEX_NULL)
+        return 0;
+
+    len = pathcache_find(search->cache, start, goal, corridor, CORRIDOR_MAX, NULL);
+    if (len != PATHCACHE_MISS)
+        return len;
+
+    if (search->ch_scratch) {
+        len = ch_find(graph, &search->ch, search->ch_scratch, start, goal,
+                      corridor, CORRIDOR_MAX, &cost);
+        *expanded = search->ch_scratch->expanded;
+    }
+    else if (search->hpa_scratch) {
+        len = hpa_find(graph, &search->hpa, search->hpa_scratch, start, goal,
+                       corridor, CORRIDOR_MAX, &cost);
+        *expanded = search->hpa_scratch->expanded;
+    }
+    else {
+        len = path_find(graph, search->scratch, start, goal, corridor, CORRIDOR_MAX, &cost);
+        *expanded = search->scratch->expanded;
+    }
+
+    pathcache_insert(search->cache, start, goal, corridor, len, cost);
+    return len;
+}
+
+int main(int argc, char **argv)
 {
     SDL_Window *window = NULL;
     SDL_Renderer *renderer = NULL;
-    int shutdown = 0;
+    struct trigraph graph;
+    struct search search;
+    struct view view;
+    struct vertex from, to;
+    struct vertex *waypoints;
+    uint16_t *corridor;
+    size_t corridor_len, waypoints_len = 0, expanded;
+    Uint64 start;
+    int shutdown = 0, width, height;
+
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s map.tri\n", argv[0]);
+        return 2;
+    }
+
+    start = SDL_GetPerformanceCounter();
+    if (trigraph_load(argv[1], &graph) < 0)
+        return 1;
+    fprintf(stderr, "loaded %zu nodes and %zu vertices from %s in %.2fms\n",
+            graph.nodes_count, graph.vertices_count, argv[1],
+            1000.0 * (SDL_GetPerformanceCounter() - start)
+                / SDL_GetPerformanceFrequency());
 
     if (SDL_Init(SDL_INIT_VIDEO) != 0) {
+        trigraph_unload(&graph);
         return 1;
     }
 
-    const uint32_t window_flags = 0;
-    window = SDL_CreateWindow("hello world",
+    search_init(&search, argv[1], &graph);
+    corridor = malloc(CORRIDOR_MAX * sizeof corridor[0]);
+    waypoints = malloc((CORRIDOR_MAX + 1) * sizeof waypoints[0]);
+    assert(corridor != NULL && waypoints != NULL);
+    from.x = from.y = to.x = to.y = 0;
+
+    const uint32_t window_flags = SDL_WINDOW_RESIZABLE;
+    window = SDL_CreateWindow(argv[1],
                               SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
-                              400, 300,
+                              800, 600,
                               window_flags);
 
     const uint32_t renderer_flags = SDL_RENDERER_ACCELERATED
                                   | SDL_RENDERER_PRESENTVSYNC;
     renderer = SDL_CreateRenderer(window, -1, renderer_flags);
 
-    SDL_Point rect_points[] = {
-        { 100, 100 },
-        { 300, 100 },
-        { 300, 200 },
-        { 100, 200 },
-        { 100, 100 },
-    };
-    int rect_points_count = 5;
+    SDL_GetRendererOutputSize(renderer, &width, &height);
+    view_fit(&view, &graph, width, height);
 
     while (!shutdown) {
         SDL_Event e;
@@ -42,14 +296,42 @@ int main(int argc __attribute__((unused)),
                 case SDL_QUIT:
                     shutdown = 1;
                     break;
+                case SDL_WINDOWEVENT:
+                    if (e.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
+                        SDL_GetRendererOutputSize(renderer, &width, &height);
+                        view_fit(&view, &graph, width, height);
+                    }
+                    break;
+                /* left button picks the start, right button the goal */
+                case SDL_MOUSEBUTTONDOWN:
+                    if (e.button.button == SDL_BUTTON_LEFT)
+                        from = view_unpoint(&view, e.button.x, e.button.y);
+                    else if (e.button.button == SDL_BUTTON_RIGHT)
+                        to = view_unpoint(&view, e.button.x, e.button.y);
+                    else
+                        break;
+
+                    start = SDL_GetPerformanceCounter();
+                    corridor_len = find_corridor(&graph, &search, &from, &to,
+                                                 corridor, &expanded);
+                    waypoints_len = path_funnel(&graph, corridor, corridor_len,
+                                                from, to,
+                                                waypoints, CORRIDOR_MAX + 1);
+                    fprintf(stderr, "corridor of %zu nodes, %zu expanded, "
+                            "%zu waypoints, in %.3fms\n",
+                            corridor_len, expanded, waypoints_len,
+                            1000.0 * (SDL_GetPerformanceCounter() - start)
+                                / SDL_GetPerformanceFrequency());
+                    break;
             }
         }
 
         SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
         SDL_RenderClear(renderer);
 
-        SDL_SetRenderDrawColor(renderer, 255, 0, 0, 255);
-        SDL_RenderDrawLines(renderer, rect_points, rect_points_count);
+        draw_trigraph(renderer, &graph, &view);
+        if (waypoints_len)
+            draw_path(renderer, &view, waypoints, waypoints_len);
 
         SDL_RenderPresent(renderer);
     }
@@ -58,5 +340,10 @@ int main(int argc __attribute__((unused)),
     SDL_DestroyWindow(window);
 
     SDL_Quit();
+
+    free(waypoints);
+    free(corridor);
+    search_fini(&search);
+    trigraph_unload(&graph);
     return 0;
 }
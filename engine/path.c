@@ -0,0 +1,449 @@
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "engine/path.h"
+#include "engine/trigraph.h"
+
+/* funnel points closer than this are the same point */
+#define FUNNEL_EPSILON (1e-4f)
+
+static float distance(const struct vertex *a, const struct vertex *b)
+{
+    const float dx = b->x - a->x, dy = b->y - a->y;
+
+    return sqrtf(dx * dx + dy * dy);
+}
+
+static void open_place(struct path_scratch *scratch, size_t i,
+                       struct path_open entry)
+{
+    scratch->open[i] = entry;
+    scratch->nodes[entry.node].heap = i;
+}
+
+static void open_up(struct path_scratch *scratch, size_t i)
+{
+    const struct path_open entry = scratch->open[i];
+
+    while (i > 0) {
+        const size_t up = (i - 1) / 2;
+
+        if (scratch->open[up].f <= entry.f) break;
+        open_place(scratch, i, scratch->open[up]);
+        i = up;
+    }
+    open_place(scratch, i, entry);
+}
+
+static void open_down(struct path_scratch *scratch, size_t i)
+{
+    const struct path_open entry = scratch->open[i];
+    const size_t n = scratch->open_count;
+
+    for (;;) {
+        size_t down = 2 * i + 1;
+
+        if (down >= n) break;
+        if (down + 1 < n && scratch->open[down + 1].f < scratch->open[down].f)
+            down ++;
+        if (entry.f <= scratch->open[down].f) break;
+        open_place(scratch, i, scratch->open[down]);
+        i = down;
+    }
+    open_place(scratch, i, entry);
+}
+
+void path_open_push(struct path_scratch *scratch, uint16_t node, float f)
+{
+    struct path_open entry;
+
+    entry.f = f;
+    entry.node = node;
+    scratch->open[scratch->open_count] = entry;
+    open_up(scratch, scratch->open_count++);
+}
+
+/* lowers the key of a node already on the heap */
+void path_open_update(struct path_scratch *scratch, uint16_t node, float f)
+{
+    const size_t i = scratch->nodes[node].heap;
+
+    scratch->open[i].f = f;
+    open_up(scratch, i);
+}
+
+uint16_t path_open_pop(struct path_scratch *scratch)
+{
+    const uint16_t node = scratch->open[0].node;
+
+    if (--scratch->open_count) {
+        scratch->open[0] = scratch->open[scratch->open_count];
+        open_down(scratch, 0);
+    }
+    scratch->nodes[node].heap = PATH_CLOSED;
+    return node;
+}
+
+/* starts a new search, invalidating every node's state at once */
+uint32_t path_begin(struct path_scratch *scratch)
+{
+    if (++scratch->generation == 0) {
+        memset(scratch->nodes, 0, scratch->nodes_count * sizeof scratch->nodes[0]);
+        scratch->generation = 1;
+    }
+    scratch->open_count = 0;
+    scratch->expanded = 0;
+    return scratch->generation;
+}
+
+/* scratch for a graph of up to INDEX_NULL - 1 nodes, with no centroids */
+struct path_scratch *path_scratch_alloc(size_t nodes_count)
+{
+    struct path_scratch *scratch;
+
+    assert(nodes_count < INDEX_NULL);
+
+    scratch = malloc(sizeof *scratch);
+    assert(scratch != NULL);
+
+    scratch->nodes_count = nodes_count;
+    scratch->generation = 0;
+    scratch->nodes = calloc(nodes_count + 1, sizeof scratch->nodes[0]);
+    scratch->centroids = NULL;
+    scratch->open = malloc((nodes_count + 1) * sizeof scratch->open[0]);
+    assert(scratch->nodes != NULL && scratch->open != NULL);
+    scratch->open_count = 0;
+    scratch->expanded = 0;
+
+    return scratch;
+}
+
+struct path_scratch *path_scratch_new(const struct trigraph *graph)
+{
+    struct path_scratch *scratch = path_scratch_alloc(graph->nodes_count);
+    size_t i;
+
+    scratch->centroids = malloc((graph->nodes_count + 1) * sizeof scratch->centroids[0]);
+    assert(scratch->centroids != NULL);
+
+    for (i = 0; i < graph->nodes_count; i++)
+        scratch->centroids[i] = trigraph_centroid(graph, i);
+
+    return scratch;
+}
+
+void path_scratch_free(struct path_scratch *scratch)
+{
+    if (!scratch) return;
+
+    free(scratch->nodes);
+    free(scratch->centroids);
+    free(scratch->open);
+    free(scratch);
+}
+
+/* what it costs to cross edge i of a node, or a negative number if it's
+ * blocked */
+float path_step(const struct path_scratch *scratch, const struct trigraph *graph,
+                uint16_t id, unsigned i)
+{
+    const struct trinode *node = &graph->nodes[id];
+
+    if (node->neighbours[i] == INDEX_NULL || node->costs[i] == COST_BLOCKED)
+        return -1;
+
+    return distance(&scratch->centroids[id], &scratch->centroids[node->neighbours[i]])
+           * node->costs[i] / COST_DEFAULT;
+}
+
+/* walks the parents back from goal.  the corridor is only written if it
+ * fits, but its length is returned either way */
+static size_t path_corridor(const struct path_scratch *scratch, uint16_t goal,
+                            uint16_t *corridor, size_t corridor_max)
+{
+    size_t len = 0, i;
+    uint16_t node;
+
+    for (node = goal; node != INDEX_NULL; node = scratch->nodes[node].parent)
+        len ++;
+
+    if (len <= corridor_max) {
+        i = len;
+        for (node = goal; node != INDEX_NULL; node = scratch->nodes[node].parent)
+            corridor[--i] = node;
+    }
+
+    return len;
+}
+
+/* a* from one node to another, with straight line distance between
+ * centroids as the heuristic, over only the nodes numbered from first up
+ * to (not including) last.  returns the number of nodes in the corridor
+ * from start to goal, both included, or 0 if goal can't be reached.
+ * corridor is left alone if it's too short for the path; cost may be
+ * NULL */
+size_t path_find_within(const struct trigraph *graph, struct path_scratch *scratch,
+                        uint16_t start, uint16_t goal, size_t first, size_t last,
+                        uint16_t *corridor, size_t corridor_max, float *cost)
+{
+    const struct vertex *target = &scratch->centroids[goal];
+    struct path_node *nodes = scratch->nodes;
+    uint32_t gen;
+
+    assert(scratch->nodes_count == graph->nodes_count);
+    assert(start < graph->nodes_count && goal < graph->nodes_count);
+
+    gen = path_begin(scratch);
+
+    nodes[start].stamp = gen;
+    nodes[start].g = 0;
+    nodes[start].parent = INDEX_NULL;
+    path_open_push(scratch, start, distance(&scratch->centroids[start], target));
+
+    while (scratch->open_count) {
+        const uint16_t current = path_open_pop(scratch);
+        const struct trinode *node = &graph->nodes[current];
+        unsigned i;
+
+        scratch->expanded ++;
+
+        if (current == goal) {
+            if (cost) *cost = nodes[goal].g;
+            return path_corridor(scratch, goal, corridor, corridor_max);
+        }
+
+        for (i = 0; i < 3; i++) {
+            const uint16_t next = node->neighbours[i];
+            const float step = path_step(scratch, graph, current, i);
+            struct path_node *n;
+            float g;
+
+            if (step < 0 || next < first || next >= last)
+                continue;
+
+            n = &nodes[next];
+            g = nodes[current].g + step;
+
+            if (n->stamp != gen) {
+                n->stamp = gen;
+                n->g = g;
+                n->parent = current;
+                path_open_push(scratch, next,
+                               g + distance(&scratch->centroids[next], target));
+            }
+            else if (n->heap != PATH_CLOSED && g < n->g) {
+                n->g = g;
+                n->parent = current;
+                path_open_update(scratch, next,
+                                 g + distance(&scratch->centroids[next], target));
+            }
+        }
+    }
+
+    return 0;
+}
+
+size_t path_find(const struct trigraph *graph, struct path_scratch *scratch,
+                 uint16_t start, uint16_t goal,
+                 uint16_t *corridor, size_t corridor_max, float *cost)
+{
+    return path_find_within(graph, scratch, start, goal, 0, graph->nodes_count,
+                            corridor, corridor_max, cost);
+}
+
+/* as path_find, between the nodes containing two points.  returns 0 if
+ * either point is off the mesh */
+size_t path_find_points(const struct trigraph *graph, struct path_scratch *scratch,
+                        struct vertex from, struct vertex to,
+                        uint16_t *corridor, size_t corridor_max, float *cost)
+{
+    const uint16_t start = trigraph_locate(graph, from.x, from.y);
+    const uint16_t goal = trigraph_locate(graph, to.x, to.y);
+
+    if (start == INDEX_NULL || goal == INDEX_NULL)
+        return 0;
+
+    return path_find(graph, scratch, start, goal, corridor, corridor_max, cost);
+}
+
+/* dijkstra out from one node over the nodes numbered from first up to
+ * last, with nothing to aim for.  afterwards each node it reached is
+ * stamped with the scratch's generation and has its cost from source in
+ * g.  reversed, g is the cost to source instead */
+void path_flood(const struct trigraph *graph, struct path_scratch *scratch,
+                uint16_t source, size_t first, size_t last, int reverse)
+{
+    struct path_node *nodes = scratch->nodes;
+    uint32_t gen;
+
+    assert(scratch->nodes_count == graph->nodes_count);
+
+    gen = path_begin(scratch);
+
+    nodes[source].stamp = gen;
+    nodes[source].g = 0;
+    nodes[source].parent = INDEX_NULL;
+    path_open_push(scratch, source, 0);
+
+    while (scratch->open_count) {
+        const uint16_t current = path_open_pop(scratch);
+        const struct trinode *node = &graph->nodes[current];
+        unsigned i, j;
+
+        scratch->expanded ++;
+
+        for (i = 0; i < 3; i++) {
+            const uint16_t next = node->neighbours[i];
+            struct path_node *n;
+            float step, g;
+
+            if (next == INDEX_NULL || next < first || next >= last)
+                continue;
+
+            if (!reverse) {
+                step = path_step(scratch, graph, current, i);
+            }
+            else {
+                for (j = 0; j < 2 && graph->nodes[next].neighbours[j] != current; j++)
+                    ;
+                step = path_step(scratch, graph, next, j);
+            }
+            if (step < 0) continue;
+
+            n = &nodes[next];
+            g = nodes[current].g + step;
+
+            if (n->stamp != gen) {
+                n->stamp = gen;
+                n->g = g;
+                n->parent = current;
+                path_open_push(scratch, next, g);
+            }
+            else if (n->heap != PATH_CLOSED && g < n->g) {
+                n->g = g;
+                n->parent = current;
+                path_open_update(scratch, next, g);
+            }
+        }
+    }
+}
+
+/* (b - a) x (c - a): positive if c is left of the line from a to b */
+static float cross(struct vertex a, struct vertex b, struct vertex c)
+{
+    return (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+}
+
+static int same_point(struct vertex a, struct vertex b)
+{
+    const float dx = b.x - a.x, dy = b.y - a.y;
+
+    return dx * dx + dy * dy < FUNNEL_EPSILON * FUNNEL_EPSILON;
+}
+
+/* the i'th portal along a corridor, as seen walking from start to goal.
+ * the first is the start point and the last the goal, both zero width;
+ * between them are the edges shared by successive nodes.  nodes wind
+ * positively, so crossing edge j the vertex after it is on the left */
+static void funnel_portal(const struct trigraph *graph,
+                          const uint16_t *corridor, size_t corridor_len,
+                          struct vertex from, struct vertex to, size_t i,
+                          struct vertex *left, struct vertex *right)
+{
+    const struct trinode *node;
+    unsigned j;
+
+    if (i == 0) {
+        *left = *right = from;
+        return;
+    }
+    if (i == corridor_len) {
+        *left = *right = to;
+        return;
+    }
+
+    node = &graph->nodes[corridor[i - 1]];
+    for (j = 0; j < 2 && node->neighbours[j] != corridor[i]; j++)
+        ;
+    assert(node->neighbours[j] == corridor[i]);
+
+    *right = graph->vertices[node->vertices[j]];
+    *left = graph->vertices[node->vertices[(j + 1) % 3]];
+}
+
+static void funnel_emit(struct vertex *waypoints, size_t waypoints_max,
+                        size_t *count, struct vertex v)
+{
+    if (*count < waypoints_max)
+        waypoints[*count] = v;
+    (*count) ++;
+}
+
+/* pulls a corridor from path_find taut: the shortest line from a point in
+ * its first node to a point in its last that stays inside it, as the list
+ * of points where it turns, from and to included.  this is the simple
+ * stupid funnel algorithm, working out each portal from the corridor as
+ * it goes, so nothing is allocated.  like path_find, it returns how many
+ * waypoints there are even when they don't all fit */
+size_t path_funnel(const struct trigraph *graph,
+                   const uint16_t *corridor, size_t corridor_len,
+                   struct vertex from, struct vertex to,
+                   struct vertex *waypoints, size_t waypoints_max)
+{
+    struct vertex apex, left, right, next_left, next_right;
+    size_t apex_index = 0, left_index = 0, right_index = 0, count = 0, i;
+
+    if (corridor_len == 0)
+        return 0;
+
+    apex = left = right = from;
+    funnel_emit(waypoints, waypoints_max, &count, apex);
+
+    for (i = 1; i <= corridor_len; i++) {
+        funnel_portal(graph, corridor, corridor_len, from, to, i,
+                      &next_left, &next_right);
+
+        /* the right side moves in, unless it crosses over the left, in
+         * which case the left is a corner and the funnel starts again
+         * from there */
+        if (cross(apex, right, next_right) >= 0) {
+            if (same_point(apex, right) || cross(apex, left, next_right) < 0) {
+                right = next_right;
+                right_index = i;
+            }
+            else {
+                apex = left;
+                apex_index = left_index;
+                funnel_emit(waypoints, waypoints_max, &count, apex);
+                left = right = apex;
+                left_index = right_index = apex_index;
+                i = apex_index;
+                continue;
+            }
+        }
+
+        /* and the same for the left side */
+        if (cross(apex, left, next_left) <= 0) {
+            if (same_point(apex, left) || cross(apex, right, next_left) > 0) {
+                left = next_left;
+                left_index = i;
+            }
+            else {
+                apex = right;
+                apex_index = right_index;
+                funnel_emit(waypoints, waypoints_max, &count, apex);
+                left = right = apex;
+                left_index = right_index = apex_index;
+                i = apex_index;
+                continue;
+            }
+        }
+    }
+
+    if (!same_point(apex, to))
+        funnel_emit(waypoints, waypoints_max, &count, to);
+
+    return count;
+}
@@ -0,0 +1,71 @@
+#ifndef ENGINE_PATH_H
+#define ENGINE_PATH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "engine/trigraph.h"
+
+/* popped off the open heap.  the heuristic is consistent while no cost is
+ * below COST_DEFAULT, so closed nodes are final */
+#define PATH_CLOSED (UINT16_MAX)
+
+/* per node search state, only meaningful where stamp matches the scratch's
+ * generation, so nothing has to be cleared between queries */
+struct path_node {
+    uint32_t stamp;
+    float g;
+    uint16_t parent;
+    uint16_t heap;              /* position in the open heap, or PATH_CLOSED */
+};
+
+struct path_open {
+    float f;
+    uint16_t node;
+};
+
+/* everything a query writes to.  one per thread: queries against the same
+ * graph may run at once as long as each has its own */
+struct path_scratch {
+    size_t nodes_count;
+    uint32_t generation;
+    struct path_node *nodes;
+    struct vertex *centroids;
+    struct path_open *open;
+    size_t open_count;
+
+    size_t expanded;            /* by the last query */
+};
+
+struct path_scratch *path_scratch_new(const struct trigraph *graph);
+struct path_scratch *path_scratch_alloc(size_t nodes_count);
+void path_scratch_free(struct path_scratch *scratch);
+
+/* the open heap, for searches over graphs other than the trigraph itself.
+ * a node's heap position is PATH_CLOSED once it has been popped */
+uint32_t path_begin(struct path_scratch *scratch);
+void path_open_push(struct path_scratch *scratch, uint16_t node, float f);
+void path_open_update(struct path_scratch *scratch, uint16_t node, float f);
+uint16_t path_open_pop(struct path_scratch *scratch);
+
+float path_step(const struct path_scratch *scratch, const struct trigraph *graph,
+                uint16_t id, unsigned i);
+
+size_t path_find(const struct trigraph *graph, struct path_scratch *scratch,
+                 uint16_t start, uint16_t goal,
+                 uint16_t *corridor, size_t corridor_max, float *cost);
+size_t path_find_within(const struct trigraph *graph, struct path_scratch *scratch,
+                        uint16_t start, uint16_t goal, size_t first, size_t last,
+                        uint16_t *corridor, size_t corridor_max, float *cost);
+void path_flood(const struct trigraph *graph, struct path_scratch *scratch,
+                uint16_t source, size_t first, size_t last, int reverse);
+size_t path_find_points(const struct trigraph *graph, struct path_scratch *scratch,
+                        struct vertex from, struct vertex to,
+                        uint16_t *corridor, size_t corridor_max, float *cost);
+
+size_t path_funnel(const struct trigraph *graph,
+                   const uint16_t *corridor, size_t corridor_len,
+                   struct vertex from, struct vertex to,
+                   struct vertex *waypoints, size_t waypoints_max);
+
+#endif
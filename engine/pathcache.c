@@ -0,0 +1,349 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "engine/pathcache.h"
+#include "engine/trigraph.h"
+
+#define PATHCACHE_NONE (UINT32_MAX)
+
+struct pathcache_block {
+    uint32_t next;                      /* PATHCACHE_NONE ends a corridor */
+    uint16_t nodes[PATHCACHE_BLOCK_NODES];
+};
+
+struct pathcache_entry {
+    uint16_t start, goal;
+    uint32_t len;
+    float cost;
+    uint32_t stamp;                     /* the clock when it was cached */
+    uint32_t block;                     /* its corridor's first */
+    uint32_t newer, older;              /* along the lru list */
+    uint32_t chain;                     /* the next in its bucket, or free */
+};
+
+struct pathcache {
+    const struct trigraph *graph;
+
+    struct pathcache_entry *entries;
+    size_t entries_max;
+    size_t entries_count;
+    uint32_t free_entry;
+    uint32_t newest, oldest;
+
+    uint32_t *buckets;
+    uint32_t buckets_mask;
+
+    struct pathcache_block *blocks;
+    size_t blocks_count;
+    size_t blocks_used;
+    uint32_t free_block;
+
+    /* bumped by each cost change, which stamps the edge with it.  an
+     * entry's corridor is good while none of the edges it crosses have a
+     * stamp after its own */
+    uint32_t clock;
+    uint32_t *changed;                  /* [nodes_count * 3] */
+
+    size_t lookups, hits, invalidated, evicted;
+};
+
+static uint32_t pathcache_bucket(const struct pathcache *cache, uint16_t start, uint16_t goal)
+{
+    uint32_t key = (uint32_t) start << 16 | goal;
+
+    key = (key ^ (key >> 16)) * 0x45d9f3b;
+    key = (key ^ (key >> 16)) * 0x45d9f3b;
+    return (key ^ (key >> 16)) & cache->buckets_mask;
+}
+
+static void lru_unlink(struct pathcache *cache, uint32_t id)
+{
+    struct pathcache_entry *entry = &cache->entries[id];
+
+    if (entry->newer != PATHCACHE_NONE)
+        cache->entries[entry->newer].older = entry->older;
+    else
+        cache->newest = entry->older;
+
+    if (entry->older != PATHCACHE_NONE)
+        cache->entries[entry->older].newer = entry->newer;
+    else
+        cache->oldest = entry->newer;
+}
+
+static void lru_push(struct pathcache *cache, uint32_t id)
+{
+    struct pathcache_entry *entry = &cache->entries[id];
+
+    entry->newer = PATHCACHE_NONE;
+    entry->older = cache->newest;
+    if (cache->newest != PATHCACHE_NONE)
+        cache->entries[cache->newest].newer = id;
+    else
+        cache->oldest = id;
+    cache->newest = id;
+}
+
+/* takes an entry out of everything and gives its blocks back */
+static void pathcache_drop(struct pathcache *cache, uint32_t id)
+{
+    struct pathcache_entry *entry = &cache->entries[id];
+    uint32_t *link = &cache->buckets[pathcache_bucket(cache, entry->start, entry->goal)];
+    uint32_t block = entry->block;
+
+    while (*link != id)
+        link = &cache->entries[*link].chain;
+    *link = entry->chain;
+
+    lru_unlink(cache, id);
+
+    while (block != PATHCACHE_NONE) {
+        const uint32_t next = cache->blocks[block].next;
+
+        cache->blocks[block].next = cache->free_block;
+        cache->free_block = block;
+        cache->blocks_used --;
+        block = next;
+    }
+
+    entry->chain = cache->free_entry;
+    cache->free_entry = id;
+    cache->entries_count --;
+}
+
+static uint32_t pathcache_lookup(const struct pathcache *cache, uint16_t start, uint16_t goal)
+{
+    uint32_t id = cache->buckets[pathcache_bucket(cache, start, goal)];
+
+    while (id != PATHCACHE_NONE) {
+        const struct pathcache_entry *entry = &cache->entries[id];
+
+        if (entry->start == start && entry->goal == goal)
+            break;
+        id = entry->chain;
+    }
+
+    return id;
+}
+
+/* whether any edge the corridor crosses has changed since it was cached */
+static int pathcache_stale(const struct pathcache *cache, const struct pathcache_entry *entry)
+{
+    const struct trinode *nodes = cache->graph->nodes;
+    uint32_t block = entry->block;
+    uint16_t from = INDEX_NULL;
+    size_t i, j;
+
+    if (entry->stamp == cache->clock)
+        return 0;
+
+    for (i = 0; i < entry->len; i++) {
+        const uint16_t to = cache->blocks[block].nodes[i % PATHCACHE_BLOCK_NODES];
+
+        if (from != INDEX_NULL) {
+            for (j = 0; j < 3; j++)
+                if (nodes[from].neighbours[j] == to)
+                    break;
+            if (j == 3 || cache->changed[3 * from + j] > entry->stamp)
+                return 1;
+        }
+
+        from = to;
+        if (i % PATHCACHE_BLOCK_NODES == PATHCACHE_BLOCK_NODES - 1)
+            block = cache->blocks[block].next;
+    }
+
+    return 0;
+}
+
+struct pathcache *pathcache_new(const struct trigraph *graph,
+                                size_t entries_max, size_t nodes_max)
+{
+    struct pathcache *cache;
+    size_t buckets = 1;
+
+    assert(entries_max > 0 && entries_max < PATHCACHE_NONE);
+
+    cache = calloc(1, sizeof *cache);
+    assert(cache != NULL);
+    cache->graph = graph;
+
+    cache->entries_max = entries_max;
+    cache->entries = malloc(entries_max * sizeof cache->entries[0]);
+    assert(cache->entries != NULL);
+
+    while (buckets < entries_max)
+        buckets *= 2;
+    cache->buckets_mask = buckets - 1;
+    cache->buckets = malloc(buckets * sizeof cache->buckets[0]);
+    assert(cache->buckets != NULL);
+
+    cache->blocks_count = (nodes_max + PATHCACHE_BLOCK_NODES - 1) / PATHCACHE_BLOCK_NODES;
+    assert(cache->blocks_count < PATHCACHE_NONE);
+    cache->blocks = malloc((cache->blocks_count + 1) * sizeof cache->blocks[0]);
+    assert(cache->blocks != NULL);
+
+    cache->changed = calloc(3 * graph->nodes_count + 1, sizeof cache->changed[0]);
+    assert(cache->changed != NULL);
+
+    pathcache_clear(cache);
+    return cache;
+}
+
+void pathcache_free(struct pathcache *cache)
+{
+    if (!cache)
+        return;
+
+    free(cache->entries);
+    free(cache->buckets);
+    free(cache->blocks);
+    free(cache->changed);
+    free(cache);
+}
+
+/* forgets every entry, but not the counts */
+void pathcache_clear(struct pathcache *cache)
+{
+    size_t i;
+
+    for (i = 0; i <= cache->buckets_mask; i++)
+        cache->buckets[i] = PATHCACHE_NONE;
+
+    for (i = 0; i < cache->entries_max; i++)
+        cache->entries[i].chain = i + 1 < cache->entries_max ? i + 1 : PATHCACHE_NONE;
+    cache->free_entry = 0;
+    cache->entries_count = 0;
+    cache->newest = cache->oldest = PATHCACHE_NONE;
+
+    for (i = 0; i < cache->blocks_count; i++)
+        cache->blocks[i].next = i + 1 < cache->blocks_count ? i + 1 : PATHCACHE_NONE;
+    cache->free_block = cache->blocks_count ? 0 : PATHCACHE_NONE;
+    cache->blocks_used = 0;
+}
+
+size_t pathcache_find(struct pathcache *cache, uint16_t start, uint16_t goal,
+                      uint16_t *corridor, size_t corridor_max, float *cost)
+{
+    struct pathcache_entry *entry;
+    uint32_t id, block;
+    size_t i;
+
+    cache->lookups ++;
+
+    id = pathcache_lookup(cache, start, goal);
+    if (id == PATHCACHE_NONE)
+        return PATHCACHE_MISS;
+
+    entry = &cache->entries[id];
+    if (pathcache_stale(cache, entry)) {
+        pathcache_drop(cache, id);
+        cache->invalidated ++;
+        return PATHCACHE_MISS;
+    }
+
+    lru_unlink(cache, id);
+    lru_push(cache, id);
+    cache->hits ++;
+
+    block = entry->block;
+    for (i = 0; i < entry->len && i < corridor_max; i += PATHCACHE_BLOCK_NODES) {
+        size_t n = entry->len - i;
+
+        if (n > PATHCACHE_BLOCK_NODES) n = PATHCACHE_BLOCK_NODES;
+        if (n > corridor_max - i) n = corridor_max - i;
+        memcpy(&corridor[i], cache->blocks[block].nodes, n * sizeof corridor[0]);
+        block = cache->blocks[block].next;
+    }
+
+    if (cost) *cost = entry->cost;
+    return entry->len;
+}
+
+/* replaces whatever was cached for the pair.  corridors too long for the
+ * whole cache, or empty, are left out */
+void pathcache_insert(struct pathcache *cache, uint16_t start, uint16_t goal,
+                      const uint16_t *corridor, size_t len, float cost)
+{
+    const size_t need = (len + PATHCACHE_BLOCK_NODES - 1) / PATHCACHE_BLOCK_NODES;
+    struct pathcache_entry *entry;
+    uint32_t id, *link;
+    size_t i;
+
+    id = pathcache_lookup(cache, start, goal);
+    if (id != PATHCACHE_NONE)
+        pathcache_drop(cache, id);
+
+    if (len == 0 || need > cache->blocks_count)
+        return;
+
+    while (cache->free_entry == PATHCACHE_NONE
+           || cache->blocks_count - cache->blocks_used < need) {
+        pathcache_drop(cache, cache->oldest);
+        cache->evicted ++;
+    }
+
+    id = cache->free_entry;
+    entry = &cache->entries[id];
+    cache->free_entry = entry->chain;
+    cache->entries_count ++;
+
+    entry->start = start;
+    entry->goal = goal;
+    entry->len = len;
+    entry->cost = cost;
+    entry->stamp = cache->clock;
+
+    /* blocks come off the free list in order, each linked to the next */
+    link = &entry->block;
+    for (i = 0; i < len; i += PATHCACHE_BLOCK_NODES) {
+        const uint32_t block = cache->free_block;
+        const size_t n = len - i < PATHCACHE_BLOCK_NODES ? len - i : PATHCACHE_BLOCK_NODES;
+
+        cache->free_block = cache->blocks[block].next;
+        cache->blocks_used ++;
+        memcpy(cache->blocks[block].nodes, &corridor[i], n * sizeof corridor[0]);
+        *link = block;
+        link = &cache->blocks[block].next;
+    }
+    *link = PATHCACHE_NONE;
+
+    link = &cache->buckets[pathcache_bucket(cache, start, goal)];
+    entry->chain = *link;
+    *link = id;
+    lru_push(cache, id);
+}
+
+/* for after graph->nodes[node].costs[edge] has changed */
+void pathcache_cost_changed(struct pathcache *cache, uint16_t node, unsigned edge)
+{
+    assert(node < cache->graph->nodes_count && edge < 3);
+
+    /* once in four billion changes, start over rather than wrap */
+    if (++cache->clock == 0) {
+        pathcache_clear(cache);
+        memset(cache->changed, 0, 3 * cache->graph->nodes_count * sizeof cache->changed[0]);
+        cache->clock = 1;
+    }
+
+    cache->changed[3 * node + edge] = cache->clock;
+}
+
+void pathcache_stats(const struct pathcache *cache, struct pathcache_stats *stats)
+{
+    const size_t buckets = (size_t) cache->buckets_mask + 1;
+
+    stats->lookups = cache->lookups;
+    stats->hits = cache->hits;
+    stats->invalidated = cache->invalidated;
+    stats->evicted = cache->evicted;
+    stats->entries = cache->entries_count;
+    stats->entries_max = cache->entries_max;
+    stats->memory_used = cache->blocks_used * sizeof cache->blocks[0];
+    stats->memory = sizeof *cache
+                  + cache->entries_max * sizeof cache->entries[0]
+                  + buckets * sizeof cache->buckets[0]
+                  + cache->blocks_count * sizeof cache->blocks[0]
+                  + 3 * cache->graph->nodes_count * sizeof cache->changed[0];
+}
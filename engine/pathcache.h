@@ -0,0 +1,54 @@
+#ifndef ENGINE_PATHCACHE_H
+#define ENGINE_PATHCACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "engine/trigraph.h"
+
+/* remembers corridors by (start, goal), for the many agents that ask for
+ * the same route.  corridors are kept in fixed size blocks carved out of
+ * one slab up front, so the cache never allocates once it's made, and the
+ * least recently used entries make way for new ones when it's full.
+ *
+ * whoever changes a trinode's costs[] calls pathcache_cost_changed, and
+ * entries whose corridors cross that edge are dropped the next time
+ * they're looked up; entries that don't cross it stay.  that's exact for
+ * costs going up.  a cost coming down can leave a cached route that's no
+ * longer the cheapest, until it's evicted or the cache is cleared.  no
+ * way at all isn't cached, as a change anywhere might open one.
+ *
+ * not locked: one per thread, as with struct path_scratch */
+
+#define PATHCACHE_BLOCK_NODES   (30)    /* with the link, 64 bytes a block */
+#define PATHCACHE_MISS          ((size_t) -1)
+
+struct pathcache_stats {
+    size_t lookups;
+    size_t hits;
+    size_t invalidated;         /* dropped for crossing a changed cost */
+    size_t evicted;             /* dropped to make room */
+    size_t entries;
+    size_t entries_max;
+    size_t memory_used;         /* bytes of slab holding corridors */
+    size_t memory;              /* bytes the cache holds in all */
+};
+
+struct pathcache;
+
+/* room for entries_max corridors of nodes_max nodes between them */
+struct pathcache *pathcache_new(const struct trigraph *graph,
+                                size_t entries_max, size_t nodes_max);
+void pathcache_free(struct pathcache *cache);
+void pathcache_clear(struct pathcache *cache);
+
+/* as path_find, but PATHCACHE_MISS if there's nothing cached */
+size_t pathcache_find(struct pathcache *cache, uint16_t start, uint16_t goal,
+                      uint16_t *corridor, size_t corridor_max, float *cost);
+void pathcache_insert(struct pathcache *cache, uint16_t start, uint16_t goal,
+                      const uint16_t *corridor, size_t len, float cost);
+
+void pathcache_cost_changed(struct pathcache *cache, uint16_t node, unsigned edge);
+void pathcache_stats(const struct pathcache *cache, struct pathcache_stats *stats);
+
+#endif
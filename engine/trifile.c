@@ -0,0 +1,384 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "engine/trifile.h"
+#include "engine/trigraph.h"
+
+/* fnv-1a */
+uint32_t trifile_check(const void *data, size_t size)
+{
+    const unsigned char *p = data;
+    uint32_t h = 2166136261u;
+    size_t i;
+
+    for (i = 0; i < size; i++)
+        h = (h ^ p[i]) * 16777619u;
+    return h;
+}
+
+static const char *check_header(struct trifile *file)
+{
+    struct trifile_header *header = &file->header;
+    uint32_t check;
+
+    if (file->size < sizeof *header) return "truncated header";
+    memcpy(header, file->data, sizeof *header);
+
+    if (memcmp(header->magic, TRIFILE_MAGIC, sizeof header->magic))
+        return "not a trigraph file";
+    if (header->byte_order != TRIFILE_BYTE_ORDER)
+        return "trigraph file has the wrong byte order";
+    if (header->version != TRIFILE_VERSION)
+        return "unsupported trigraph file version";
+
+    check = header->header_check;
+    header->header_check = 0;
+    if (trifile_check(header, sizeof *header) != check)
+        return "header checksum mismatch";
+    header->header_check = check;
+
+    if (header->sections_count > TRIFILE_MAX_SECTIONS)
+        return "too many sections";
+    if (header->nodes_count > INDEX_NULL || header->vertices_count > INDEX_NULL)
+        return "too many nodes or vertices";
+
+    return NULL;
+}
+
+/* maps a file and checks its header.  pages are private, so whoever maps
+ * it can change things in place without touching the file.  returns -1
+ * (having said why) if the file is no good */
+int trifile_open(const char *filename, struct trifile *file)
+{
+    struct stat stat_buf;
+    const char *error;
+    void *data;
+    int fd;
+
+    memset(file, 0, sizeof *file);
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0) goto fail;
+
+    if (fstat(fd, &stat_buf) < 0) {
+        close(fd);
+        goto fail;
+    }
+    if (stat_buf.st_size == 0) {
+        close(fd);
+        errno = EINVAL;
+        goto fail;
+    }
+
+    data = mmap(NULL, stat_buf.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        close(fd);
+        goto fail;
+    }
+    close(fd);
+
+    file->data = data;
+    file->size = stat_buf.st_size;
+
+    error = check_header(file);
+    if (error) {
+        fprintf(stderr, "%s: %s\n", filename, error);
+        munmap(file->data, file->size);
+        memset(file, 0, sizeof *file);
+        return -1;
+    }
+
+    return 0;
+
+fail:
+    fprintf(stderr, "unable to read %s: %s\n", filename, strerror(errno));
+    return -1;
+}
+
+/* finds a section, checking it lies within the file and is intact */
+const char *trifile_section(const struct trifile *file, uint32_t tag,
+                            void **data, size_t *size)
+{
+    const struct trifile_section *section, *found = NULL;
+    uint32_t i;
+
+    for (i = 0; i < file->header.sections_count; i++) {
+        section = &file->header.sections[i];
+        if (section->tag != tag) continue;
+
+        if (found)
+            return "duplicate section";
+        if (section->offset % TRIFILE_ALIGN)
+            return "misaligned section";
+        if (section->offset > file->size
+            || section->size > file->size - section->offset)
+            return "section runs past the end of the file";
+        if (trifile_check(file->data + section->offset, section->size)
+            != section->check)
+            return "section checksum mismatch";
+
+        found = section;
+    }
+
+    if (!found) return "missing section";
+
+    *data = file->data + found->offset;
+    *size = found->size;
+    return NULL;
+}
+
+void trifile_close(struct trifile *file)
+{
+    if (file->data)
+        munmap(file->data, file->size);
+    memset(file, 0, sizeof *file);
+}
+
+/* writes a header and then the sections in the order given.  the header
+ * goes down last, so a file cut short is never mistaken for a good one.
+ * check, if not NULL, gets the header's checksum */
+int trifile_write(const char *filename, uint32_t nodes_count, uint32_t vertices_count,
+                  const struct trifile_blob *blobs, size_t blobs_count,
+                  uint32_t *check)
+{
+    static const char zeros[TRIFILE_PAD(sizeof(struct trifile_header))];
+    struct trifile_header header;
+    size_t offset, i;
+    FILE *out;
+    int err;
+
+    if (blobs_count > TRIFILE_MAX_SECTIONS) {
+        fprintf(stderr, "%s: too many sections\n", filename);
+        return -1;
+    }
+
+    out = fopen(filename, "wb");
+    if (!out) {
+        fprintf(stderr, "unable to open %s: %s\n", filename, strerror(errno));
+        return -1;
+    }
+
+    memset(&header, 0, sizeof header);
+    memcpy(header.magic, TRIFILE_MAGIC, sizeof header.magic);
+    header.version = TRIFILE_VERSION;
+    header.byte_order = TRIFILE_BYTE_ORDER;
+    header.nodes_count = nodes_count;
+    header.vertices_count = vertices_count;
+
+    /* room for the header, which is filled in once the sections are down */
+    fwrite(zeros, 1, TRIFILE_PAD(sizeof header), out);
+    offset = TRIFILE_PAD(sizeof header);
+
+    for (i = 0; i < blobs_count; i++) {
+        struct trifile_section *section = &header.sections[header.sections_count++];
+
+        section->tag = blobs[i].tag;
+        section->check = trifile_check(blobs[i].data, blobs[i].size);
+        section->offset = offset;
+        section->size = blobs[i].size;
+
+        if (blobs[i].size) fwrite(blobs[i].data, 1, blobs[i].size, out);
+        fwrite(zeros, 1, TRIFILE_PAD(blobs[i].size) - blobs[i].size, out);
+        offset += TRIFILE_PAD(blobs[i].size);
+    }
+
+    header.header_check = trifile_check(&header, sizeof header);
+    if (fseek(out, 0, SEEK_SET) == 0)
+        fwrite(&header, sizeof header, 1, out);
+
+    err = ferror(out);
+    if (fclose(out) || err) {
+        fprintf(stderr, "error writing %s: %s\n", filename, strerror(errno));
+        remove(filename);
+        return -1;
+    }
+
+    if (check) *check = header.header_check;
+    return 0;
+}
+
+/* whether node k lists node i back across the same two vertices */
+static int links_back(const struct trigraph *graph, uint16_t i, unsigned j, uint16_t k)
+{
+    const uint16_t *v = graph->nodes[i].vertices;
+    const struct trinode *other = &graph->nodes[k];
+    const uint16_t a = v[j], b = v[(j + 1) % 3];
+    unsigned m;
+
+    for (m = 0; m < 3; m++) {
+        const uint16_t c = other->vertices[m], d = other->vertices[(m + 1) % 3];
+
+        if (other->neighbours[m] == i && ((c == a && d == b) || (c == b && d == a)))
+            return 1;
+    }
+
+    return 0;
+}
+
+/* everything the engine will take on trust later, checked once up front:
+ * indices in range, vertices finite, and neighbours agreeing with each
+ * other, which the funnel and searches run backwards count on */
+static const char *validate(const struct trigraph *graph)
+{
+    size_t i, j;
+
+    for (i = 0; i < graph->vertices_count; i++) {
+        if (!isfinite(graph->vertices[i].x) || !isfinite(graph->vertices[i].y))
+            return "vertex isn't finite";
+    }
+
+    for (i = 0; i < graph->nodes_count; i++) {
+        const struct trinode *node = &graph->nodes[i];
+
+        for (j = 0; j < 3; j++) {
+            if (node->vertices[j] >= graph->vertices_count)
+                return "node refers to missing vertex";
+            if (node->neighbours[j] != INDEX_NULL
+                && node->neighbours[j] >= graph->nodes_count)
+                return "node refers to missing neighbour";
+        }
+    }
+
+    for (i = 0; i < graph->nodes_count; i++) {
+        const struct trinode *node = &graph->nodes[i];
+
+        for (j = 0; j < 3; j++) {
+            if (node->neighbours[j] == INDEX_NULL)
+                continue;
+            if (node->neighbours[j] == i)
+                return "node is its own neighbour";
+            if (!links_back(graph, i, j, node->neighbours[j]))
+                return "neighbours don't match";
+        }
+    }
+
+    return NULL;
+}
+
+static int has_section(const struct trifile *file, uint32_t tag)
+{
+    uint32_t i;
+
+    for (i = 0; i < file->header.sections_count; i++)
+        if (file->header.sections[i].tag == tag)
+            return 1;
+    return 0;
+}
+
+/* the grid, if the file has one, checked as thoroughly as the nodes */
+static const char *grid_apply(const struct trifile *file, struct trigraph *graph)
+{
+    void *params, *first, *nodes;
+    size_t params_size, first_size, nodes_size, cells, i;
+    const struct trigrid *grid;
+    const char *error;
+
+    if (!has_section(file, TRIFILE_GRID))
+        return NULL;
+
+    if ((error = trifile_section(file, TRIFILE_GRID, &params, &params_size)))
+        return error;
+    if ((error = trifile_section(file, TRIFILE_GRID_FIRST, &first, &first_size)))
+        return error;
+    if ((error = trifile_section(file, TRIFILE_GRID_NODES, &nodes, &nodes_size)))
+        return error;
+
+    if (params_size != sizeof *grid)
+        return "bad grid";
+    grid = params;
+    if (!(grid->cell_size > 0) || !isfinite(grid->cell_size)
+        || !isfinite(grid->min_x) || !isfinite(grid->min_y)
+        || grid->columns == 0 || grid->rows == 0)
+        return "bad grid";
+
+    cells = (size_t) grid->columns * grid->rows;
+    if (cells / grid->columns != grid->rows
+        || first_size != (cells + 1) * sizeof graph->grid_first[0]
+        || nodes_size != grid->entries_count * sizeof graph->grid_nodes[0])
+        return "section size doesn't match its count";
+
+    graph->grid = *grid;
+    graph->grid_first = first;
+    graph->grid_nodes = nodes;
+
+    if (graph->grid_first[0] != 0 || graph->grid_first[cells] != grid->entries_count)
+        return "bad grid";
+    for (i = 0; i < cells; i++)
+        if (graph->grid_first[i] > graph->grid_first[i + 1])
+            return "bad grid";
+    for (i = 0; i < grid->entries_count; i++)
+        if (graph->grid_nodes[i] >= graph->nodes_count)
+            return "grid refers to missing node";
+
+    return NULL;
+}
+
+static const char *trigraph_apply(const struct trifile *file, struct trigraph *graph)
+{
+    void *nodes, *vertices;
+    size_t nodes_size, vertices_size;
+    const char *error;
+
+    if ((error = trifile_section(file, TRIFILE_NODES, &nodes, &nodes_size)))
+        return error;
+    if ((error = trifile_section(file, TRIFILE_VERTICES, &vertices, &vertices_size)))
+        return error;
+
+    if (nodes_size != file->header.nodes_count * sizeof graph->nodes[0]
+        || vertices_size != file->header.vertices_count * sizeof graph->vertices[0])
+        return "section size doesn't match its count";
+
+    graph->nodes = nodes;
+    graph->nodes_size = nodes_size;
+    graph->nodes_count = file->header.nodes_count;
+    graph->vertices = vertices;
+    graph->vertices_size = vertices_size;
+    graph->vertices_count = file->header.vertices_count;
+
+    if ((error = validate(graph)))
+        return error;
+    return grid_apply(file, graph);
+}
+
+/* maps a file baked by tools/mapc, pointing the trigraph straight into
+ * it, so the engine can change costs in place without touching the file.
+ * returns -1 (having said why) if the file is no good */
+int trigraph_load(const char *filename, struct trigraph *graph)
+{
+    struct trifile file;
+    const char *error;
+
+    memset(graph, 0, sizeof *graph);
+
+    if (trifile_open(filename, &file) < 0)
+        return -1;
+
+    graph->file = file.data;
+    graph->file_size = file.size;
+    graph->check = file.header.header_check;
+
+    error = trigraph_apply(&file, graph);
+    if (error) {
+        fprintf(stderr, "%s: %s\n", filename, error);
+        trigraph_unload(graph);
+        return -1;
+    }
+
+    return 0;
+}
+
+void trigraph_unload(struct trigraph *graph)
+{
+    if (graph->file)
+        munmap(graph->file, graph->file_size);
+    memset(graph, 0, sizeof *graph);
+}
@@ -0,0 +1,89 @@
+#ifndef ENGINE_TRIFILE_H
+#define ENGINE_TRIFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* baked trigraph files, as written by tools/mapc.  a fixed size header,
+ * then each section on a TRIFILE_ALIGN boundary:
+ *   TRIFILE_NODES      struct trinode[nodes_count]
+ *   TRIFILE_VERTICES   struct vertex[vertices_count]
+ *   TRIFILE_GRID       struct trigrid
+ *   TRIFILE_GRID_FIRST uint32_t[columns * rows + 1]
+ *   TRIFILE_GRID_NODES uint16_t[entries_count]
+ * the grid sections are optional, and trigraph_locate tests every node in
+ * turn without them.  the header lists where each section is and a
+ * checksum of it, and has a checksum of its own (taken with header_check
+ * zeroed).  everything is in native byte order, which byte_order records.
+ * sections a reader doesn't know about are skipped.
+ *
+ * companion files baked from a trigraph (engine/hpa.h) use the same
+ * layout with their own sections, and the counts of the trigraph
+ */
+#define TRIFILE_MAGIC           "sadtri\r\n"
+#define TRIFILE_VERSION         (1)
+#define TRIFILE_BYTE_ORDER      (0x01020304)
+#define TRIFILE_ALIGN           (64)
+#define TRIFILE_MAX_SECTIONS    (8)
+
+#define TRIFILE_TAG(a,b,c,d)    ((uint32_t) (a)         \
+                                | (uint32_t) (b) << 8   \
+                                | (uint32_t) (c) << 16  \
+                                | (uint32_t) (d) << 24)
+
+#define TRIFILE_NODES           TRIFILE_TAG('N','O','D','E')
+#define TRIFILE_VERTICES        TRIFILE_TAG('V','E','R','T')
+#define TRIFILE_GRID            TRIFILE_TAG('G','R','I','D')
+#define TRIFILE_GRID_FIRST      TRIFILE_TAG('G','R','D','F')
+#define TRIFILE_GRID_NODES      TRIFILE_TAG('G','R','D','N')
+
+struct trifile_section {
+    uint32_t tag;
+    uint32_t check;
+    uint64_t offset;            /* from the start of the file */
+    uint64_t size;              /* in bytes, not counting padding */
+};
+
+struct trifile_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t nodes_count;
+    uint32_t vertices_count;
+    uint32_t sections_count;
+    uint32_t header_check;
+    struct trifile_section sections[TRIFILE_MAX_SECTIONS];
+};
+
+#define TRIFILE_PAD(n) (((n) + TRIFILE_ALIGN - 1) & ~(size_t) (TRIFILE_ALIGN - 1))
+
+/* a mapped file whose header has been checked, but not its sections */
+struct trifile {
+    char *data;
+    size_t size;
+    struct trifile_header header;
+};
+
+/* a section to write */
+struct trifile_blob {
+    uint32_t tag;
+    const void *data;
+    size_t size;
+};
+
+uint32_t trifile_check(const void *data, size_t size);
+
+int trifile_open(const char *filename, struct trifile *file);
+const char *trifile_section(const struct trifile *file, uint32_t tag,
+                            void **data, size_t *size);
+void trifile_close(struct trifile *file);
+int trifile_write(const char *filename, uint32_t nodes_count, uint32_t vertices_count,
+                  const struct trifile_blob *blobs, size_t blobs_count,
+                  uint32_t *check);
+
+struct trigraph;
+
+int trigraph_load(const char *filename, struct trigraph *graph);
+void trigraph_unload(struct trigraph *graph);
+
+#endif
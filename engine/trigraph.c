@@ -0,0 +1,223 @@
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "engine/trigraph.h"
+
+struct vertex trigraph_centroid(const struct trigraph *graph, uint16_t id)
+{
+    const struct trinode *node = &graph->nodes[id];
+    const struct vertex *a = &graph->vertices[node->vertices[0]];
+    const struct vertex *b = &graph->vertices[node->vertices[1]];
+    const struct vertex *c = &graph->vertices[node->vertices[2]];
+    struct vertex centroid;
+
+    centroid.x = (a->x + b->x + c->x) / 3;
+    centroid.y = (a->y + b->y + c->y) / 3;
+    return centroid;
+}
+
+/* on an edge counts as inside.  nodes are wound positively, so inside is
+ * to the left of every edge */
+int trigraph_contains(const struct trigraph *graph, uint16_t id, float x, float y)
+{
+    const struct trinode *node = &graph->nodes[id];
+    unsigned i;
+
+    for (i = 0; i < 3; i++) {
+        const struct vertex *a = &graph->vertices[node->vertices[i]];
+        const struct vertex *b = &graph->vertices[node->vertices[(i + 1) % 3]];
+
+        if ((double) (b->x - a->x) * (y - a->y) - (double) (b->y - a->y) * (x - a->x) < 0)
+            return 0;
+    }
+
+    return 1;
+}
+
+/* the column or row a coordinate falls in, clamped to the grid.  points
+ * off the grid are off the mesh too, and the nearest cell is as good as
+ * any for finding that out */
+static uint32_t grid_index(float v, float min, float cell_size, uint32_t count)
+{
+    const float f = floorf((v - min) / cell_size);
+
+    if (!(f >= 0)) return 0;
+    if (f >= count) return count - 1;
+    return f;
+}
+
+/* the node containing a point, or INDEX_NULL if it's off the mesh.  on a
+ * shared edge, the lower numbered node.  without a grid, this tests every
+ * node in turn */
+uint16_t trigraph_locate(const struct trigraph *graph, float x, float y)
+{
+    const struct trigrid *grid = &graph->grid;
+    uint32_t cell, i;
+
+    if (grid->columns == 0) {
+        for (i = 0; i < graph->nodes_count; i++) {
+            if (trigraph_contains(graph, i, x, y))
+                return i;
+        }
+        return INDEX_NULL;
+    }
+
+    cell = grid_index(y, grid->min_y, grid->cell_size, grid->rows) * grid->columns
+         + grid_index(x, grid->min_x, grid->cell_size, grid->columns);
+
+    for (i = graph->grid_first[cell]; i < graph->grid_first[cell + 1]; i++) {
+        if (trigraph_contains(graph, graph->grid_nodes[i], x, y))
+            return graph->grid_nodes[i];
+    }
+
+    return INDEX_NULL;
+}
+
+/* the point on a segment nearest (x, y), and the squared distance to it */
+static double nearest_on_edge(const struct vertex *a, const struct vertex *b,
+                              float x, float y, struct vertex *nearest)
+{
+    const double dx = (double) b->x - a->x, dy = (double) b->y - a->y;
+    const double len2 = dx * dx + dy * dy;
+    double t = 0, ex, ey;
+
+    if (len2 > 0) {
+        t = (((double) x - a->x) * dx + ((double) y - a->y) * dy) / len2;
+        if (t < 0) t = 0;
+        if (t > 1) t = 1;
+    }
+
+    nearest->x = a->x + t * dx;
+    nearest->y = a->y + t * dy;
+    ex = (double) nearest->x - x;
+    ey = (double) nearest->y - y;
+    return ex * ex + ey * ey;
+}
+
+/* the point of a node nearest (x, y), and the squared distance to it */
+static double nearest_on_node(const struct trigraph *graph, uint16_t id,
+                              float x, float y, struct vertex *nearest)
+{
+    const struct trinode *node = &graph->nodes[id];
+    double best = -1;
+    unsigned i;
+
+    if (trigraph_contains(graph, id, x, y)) {
+        nearest->x = x;
+        nearest->y = y;
+        return 0;
+    }
+
+    for (i = 0; i < 3; i++) {
+        struct vertex v;
+        const double d = nearest_on_edge(&graph->vertices[node->vertices[i]],
+                                         &graph->vertices[node->vertices[(i + 1) % 3]],
+                                         x, y, &v);
+
+        if (best < 0 || d < best) {
+            best = d;
+            *nearest = v;
+        }
+    }
+
+    return best;
+}
+
+struct nearest_state {
+    float x, y;
+    uint16_t id;
+    double distance;            /* squared */
+    struct vertex point;
+};
+
+static void nearest_test(const struct trigraph *graph, struct nearest_state *state,
+                         uint16_t id)
+{
+    struct vertex v;
+    const double d = nearest_on_node(graph, id, state->x, state->y, &v);
+
+    if (state->id == INDEX_NULL || d < state->distance
+        || (d == state->distance && id < state->id)) {
+        state->id = id;
+        state->distance = d;
+        state->point = v;
+    }
+}
+
+static void nearest_cell(const struct trigraph *graph, struct nearest_state *state,
+                         uint32_t cell)
+{
+    uint32_t i;
+
+    for (i = graph->grid_first[cell]; i < graph->grid_first[cell + 1]; i++)
+        nearest_test(graph, state, graph->grid_nodes[i]);
+}
+
+/* as trigraph_locate, but a point off the mesh comes back as the node
+ * nearest it, with nearest (if not NULL) moved onto that node.  with a
+ * grid, this looks through rings of cells outwards from the point until
+ * no cell further out could hold anything nearer.  INDEX_NULL only if
+ * there are no nodes at all */
+uint16_t trigraph_nearest(const struct trigraph *graph, float x, float y,
+                          struct vertex *nearest)
+{
+    const struct trigrid *grid = &graph->grid;
+    struct nearest_state state;
+    uint32_t column, row, r, i;
+
+    state.x = x;
+    state.y = y;
+    state.id = trigraph_locate(graph, x, y);
+    state.point.x = x;
+    state.point.y = y;
+    state.distance = 0;
+
+    if (state.id != INDEX_NULL || graph->nodes_count == 0) {
+        if (nearest) *nearest = state.point;
+        return state.id;
+    }
+
+    if (grid->columns == 0) {
+        for (i = 0; i < graph->nodes_count; i++)
+            nearest_test(graph, &state, i);
+        if (nearest) *nearest = state.point;
+        return state.id;
+    }
+
+    /* from a point off the grid, nothing on it is any nearer than from the
+     * nearest point that is on it, which is in the clamped cell */
+    column = grid_index(x, grid->min_x, grid->cell_size, grid->columns);
+    row = grid_index(y, grid->min_y, grid->cell_size, grid->rows);
+
+    for (r = 0; ; r++) {
+        const double reach = (double) r * grid->cell_size;
+        const uint32_t x0 = column > r ? column - r : 0;
+        const uint32_t y0 = row > r ? row - r : 0;
+        const uint32_t x1 = column + r < grid->columns ? column + r : grid->columns - 1;
+        const uint32_t y1 = row + r < grid->rows ? row + r : grid->rows - 1;
+        uint32_t cx, cy;
+
+        /* just the ring itself; inside it has been seen already */
+        for (cy = y0; cy <= y1; cy++) {
+            if (cy + r == row || cy == row + r) {
+                for (cx = x0; cx <= x1; cx++)
+                    nearest_cell(graph, &state, cy * grid->columns + cx);
+                continue;
+            }
+            if (x0 + r == column)
+                nearest_cell(graph, &state, cy * grid->columns + x0);
+            if (r > 0 && x1 == column + r)
+                nearest_cell(graph, &state, cy * grid->columns + x1);
+        }
+
+        /* cells in the next ring are at least r cells away */
+        if (state.id != INDEX_NULL && state.distance <= reach * reach)
+            break;
+        if (x0 == 0 && y0 == 0 && x1 == grid->columns - 1 && y1 == grid->rows - 1)
+            break;
+    }
+
+    if (nearest) *nearest = state.point;
+    return state.id;
+}
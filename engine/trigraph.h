@@ -1,10 +1,17 @@
 #ifndef ENGINE_TRIGRAPH_H
 #define ENGINE_TRIGRAPH_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 #define INDEX_NULL (UINT16_MAX)
 
+/* a step across edge i of a trinode costs the distance between the two
+ * centroids, times costs[i] / COST_DEFAULT.  edges with no neighbour are
+ * COST_BLOCKED */
+#define COST_DEFAULT (16)
+#define COST_BLOCKED (0)
+
 struct vertex {
     float x;
     float y;
@@ -12,11 +19,24 @@ struct vertex {
 
 struct trinode {
     uint16_t vertices[3];
-    uint16_t neighbours[3];
+    uint16_t neighbours[3];     /* across the edge from vertices[i] to [i + 1] */
     uint8_t  costs[3];
     uint8_t  __pad;
 };
 
+/* a uniform grid over the nodes' bounds, each cell listing the nodes that
+ * overlap it, so finding the node under a point takes a few triangle
+ * tests.  cell (column, row) covers min_x + column * cell_size onwards,
+ * and its nodes are grid_nodes[grid_first[row * columns + column]] up to
+ * the next cell's first, by id */
+struct trigrid {
+    float min_x, min_y;
+    float cell_size;
+    uint32_t columns;           /* 0 if there's no grid */
+    uint32_t rows;
+    uint32_t entries_count;
+};
+
 struct trigraph {
     struct trinode *nodes;
     size_t nodes_size;
@@ -24,6 +44,20 @@ struct trigraph {
     struct vertex *vertices;
     size_t vertices_size;
     size_t vertices_count;
+
+    void *file;                 /* the mapping nodes and vertices point into */
+    size_t file_size;
+    uint32_t check;             /* of the file's header, which companions record */
+
+    struct trigrid grid;
+    uint32_t *grid_first;       /* [columns * rows + 1] */
+    uint16_t *grid_nodes;       /* [entries_count] */
 };
 
+struct vertex trigraph_centroid(const struct trigraph *graph, uint16_t id);
+int trigraph_contains(const struct trigraph *graph, uint16_t id, float x, float y);
+uint16_t trigraph_locate(const struct trigraph *graph, float x, float y);
+uint16_t trigraph_nearest(const struct trigraph *graph, float x, float y,
+                          struct vertex *nearest);
+
 #endif
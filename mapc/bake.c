@@ -0,0 +1,394 @@
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "engine/trigraph.h"
+#include "mapc/bake.h"
+#include "mapc/read.h"
+
+/* the most nodes or vertices a trigraph can index, INDEX_NULL aside */
+#define BAKE_MAX_INDEX ((size_t) INDEX_NULL)
+
+/* cells in the point location grid, for each node.  enough that a cell
+ * holds a handful of nodes, without a sparse map's empty space blowing up
+ * the grid */
+#define BAKE_GRID_CELLS_PER_NODE (2)
+
+/* one side of an edge, smallest vertex first */
+struct bake_edge {
+    uint32_t lo;
+    uint32_t hi;
+    uint32_t node;
+    uint32_t edge;
+};
+
+static uint32_t morton_spread(uint32_t x)
+{
+    x &= 0xffff;
+    x = (x | (x << 8)) & 0x00ff00ff;
+    x = (x | (x << 4)) & 0x0f0f0f0f;
+    x = (x | (x << 2)) & 0x33333333;
+    x = (x | (x << 1)) & 0x55555555;
+    return x;
+}
+
+static int code_cmp(const void *a, const void *b)
+{
+    const uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+
+    return (x > y) - (x < y);
+}
+
+static int edge_cmp(const void *a, const void *b)
+{
+    const struct bake_edge *x = a, *y = b;
+
+    if (x->lo != y->lo) return (x->lo > y->lo) - (x->lo < y->lo);
+    return (x->hi > y->hi) - (x->hi < y->hi);
+}
+
+/* the map's nodes in morton order of their centroids, so nodes near each
+ * other on the map tend to be near each other in memory too */
+static uint32_t *bake_order(const struct mapc_map *map)
+{
+    uint64_t *codes;
+    uint32_t *order;
+    float min_x = 0, min_y = 0, max_x = 0, max_y = 0;
+    double sx, sy;
+    size_t i;
+
+    codes = malloc((map->nodes_count + 1) * sizeof codes[0]);
+    order = malloc((map->nodes_count + 1) * sizeof order[0]);
+    assert(codes != NULL && order != NULL);
+
+    for (i = 0; i < map->verts_count; i++) {
+        if (i == 0 || map->xs[i] < min_x) min_x = map->xs[i];
+        if (i == 0 || map->ys[i] < min_y) min_y = map->ys[i];
+        if (i == 0 || map->xs[i] > max_x) max_x = map->xs[i];
+        if (i == 0 || map->ys[i] > max_y) max_y = map->ys[i];
+    }
+
+    sx = (max_x > min_x) ? 65535.0 / ((double) max_x - min_x) : 0;
+    sy = (max_y > min_y) ? 65535.0 / ((double) max_y - min_y) : 0;
+
+    for (i = 0; i < map->nodes_count; i++) {
+        const uint32_t *v = &map->nodes[3 * i];
+        const double cx = ((double) map->xs[v[0]] + map->xs[v[1]] + map->xs[v[2]]) / 3;
+        const double cy = ((double) map->ys[v[0]] + map->ys[v[1]] + map->ys[v[2]]) / 3;
+        const uint32_t qx = (cx - min_x) * sx, qy = (cy - min_y) * sy;
+
+        codes[i] = (uint64_t) (morton_spread(qx) | (morton_spread(qy) << 1)) << 32 | i;
+    }
+
+    qsort(codes, map->nodes_count, sizeof codes[0], &code_cmp);
+
+    for (i = 0; i < map->nodes_count; i++)
+        order[i] = (uint32_t) codes[i];
+
+    free(codes);
+    return order;
+}
+
+/* links up nodes that share an edge.  an edge shared by more than two
+ * nodes isn't manifold, and is left unlinked rather than guessing */
+static void bake_neighbours(struct trigraph *graph, struct mapc_stats *stats)
+{
+    struct bake_edge *edges;
+    const size_t n = 3 * graph->nodes_count;
+    size_t i, j;
+
+    edges = malloc((n + 1) * sizeof edges[0]);
+    assert(edges != NULL);
+
+    for (i = 0; i < graph->nodes_count; i++) {
+        const uint16_t *v = graph->nodes[i].vertices;
+
+        for (j = 0; j < 3; j++) {
+            struct bake_edge *e = &edges[3 * i + j];
+            const uint16_t a = v[j], b = v[(j + 1) % 3];
+
+            e->lo = a < b ? a : b;
+            e->hi = a < b ? b : a;
+            e->node = i;
+            e->edge = j;
+        }
+    }
+
+    qsort(edges, n, sizeof edges[0], &edge_cmp);
+
+    for (i = 0; i < n; i = j) {
+        for (j = i + 1; j < n && !edge_cmp(&edges[i], &edges[j]); j++)
+            ;
+
+        if (j - i == 2) {
+            struct trinode *a = &graph->nodes[edges[i].node];
+            struct trinode *b = &graph->nodes[edges[i + 1].node];
+
+            a->neighbours[edges[i].edge] = edges[i + 1].node;
+            a->costs[edges[i].edge] = COST_DEFAULT;
+            b->neighbours[edges[i + 1].edge] = edges[i].node;
+            b->costs[edges[i + 1].edge] = COST_DEFAULT;
+        }
+        else if (j - i == 1) {
+            stats->boundary_edges ++;
+        }
+        else {
+            fprintf(stderr, "mapc: edge between vertices (%g, %g) and (%g, %g) "
+                    "is shared by %zu nodes, leaving it unlinked\n",
+                    graph->vertices[edges[i].lo].x, graph->vertices[edges[i].lo].y,
+                    graph->vertices[edges[i].hi].x, graph->vertices[edges[i].hi].y,
+                    j - i);
+            stats->nonmanifold_edges ++;
+        }
+    }
+
+    free(edges);
+}
+
+/* whether a node overlaps a rectangle: nodes are convex and wound
+ * positively, so they miss it only if it's wholly to the right of one of
+ * their edges (or off to one side, which the caller rules out) */
+static int bake_overlaps(const struct trigraph *graph, const struct trinode *node,
+                         double x0, double y0, double x1, double y1)
+{
+    unsigned i;
+
+    for (i = 0; i < 3; i++) {
+        const struct vertex *a = &graph->vertices[node->vertices[i]];
+        const struct vertex *b = &graph->vertices[node->vertices[(i + 1) % 3]];
+        const double dx = (double) b->x - a->x, dy = (double) b->y - a->y;
+
+        if (dx * (y0 - a->y) - dy * (x0 - a->x) < 0
+            && dx * (y0 - a->y) - dy * (x1 - a->x) < 0
+            && dx * (y1 - a->y) - dy * (x0 - a->x) < 0
+            && dx * (y1 - a->y) - dy * (x1 - a->x) < 0)
+            return 0;
+    }
+
+    return 1;
+}
+
+/* calls visit on each cell of the grid a node overlaps.  cells are grown a
+ * little each way first, so a point rounding into the cell next door
+ * still finds its node */
+static void bake_grid_cells(struct trigraph *graph, const struct trinode *node,
+                            uint16_t id, void (*visit)(struct trigraph *, uint32_t, uint16_t))
+{
+    const struct trigrid *grid = &graph->grid;
+    const double size = grid->cell_size, slack = size / 1024;
+    double lo_x = INFINITY, lo_y = INFINITY, hi_x = -INFINITY, hi_y = -INFINITY;
+    int64_t c0, c1, r0, r1, c, r;
+    unsigned i;
+
+    for (i = 0; i < 3; i++) {
+        const struct vertex *v = &graph->vertices[node->vertices[i]];
+
+        if (v->x < lo_x) lo_x = v->x;
+        if (v->y < lo_y) lo_y = v->y;
+        if (v->x > hi_x) hi_x = v->x;
+        if (v->y > hi_y) hi_y = v->y;
+    }
+
+    c0 = floor((lo_x - slack - grid->min_x) / size);
+    r0 = floor((lo_y - slack - grid->min_y) / size);
+    c1 = floor((hi_x + slack - grid->min_x) / size);
+    r1 = floor((hi_y + slack - grid->min_y) / size);
+    if (c0 < 0) c0 = 0;
+    if (r0 < 0) r0 = 0;
+    if (c1 >= grid->columns) c1 = grid->columns - 1;
+    if (r1 >= grid->rows) r1 = grid->rows - 1;
+
+    for (r = r0; r <= r1; r++) {
+        for (c = c0; c <= c1; c++) {
+            const double x0 = grid->min_x + c * size, y0 = grid->min_y + r * size;
+
+            if (bake_overlaps(graph, node, x0 - slack, y0 - slack,
+                              x0 + size + slack, y0 + size + slack))
+                visit(graph, r * grid->columns + c, id);
+        }
+    }
+}
+
+static void bake_grid_count(struct trigraph *graph, uint32_t cell, uint16_t id)
+{
+    (void) id;
+    graph->grid_first[cell + 1] ++;
+}
+
+static void bake_grid_fill(struct trigraph *graph, uint32_t cell, uint16_t id)
+{
+    graph->grid_nodes[graph->grid_first[cell] ++] = id;
+}
+
+/* sizes cells at about the mean node's area, growing them if the
+ * map's bounds are mostly empty, then buckets the nodes over them */
+static void bake_grid(struct trigraph *graph)
+{
+    struct trigrid *grid = &graph->grid;
+    double max_x, max_y, area = 0, size;
+    size_t cells, i;
+
+    memset(grid, 0, sizeof *grid);
+    if (graph->nodes_count == 0)
+        return;
+
+    grid->min_x = max_x = graph->vertices[0].x;
+    grid->min_y = max_y = graph->vertices[0].y;
+    for (i = 1; i < graph->vertices_count; i++) {
+        const struct vertex *v = &graph->vertices[i];
+
+        if (v->x < grid->min_x) grid->min_x = v->x;
+        if (v->y < grid->min_y) grid->min_y = v->y;
+        if (v->x > max_x) max_x = v->x;
+        if (v->y > max_y) max_y = v->y;
+    }
+
+    for (i = 0; i < graph->nodes_count; i++) {
+        const struct trinode *node = &graph->nodes[i];
+        const struct vertex *a = &graph->vertices[node->vertices[0]];
+        const struct vertex *b = &graph->vertices[node->vertices[1]];
+        const struct vertex *c = &graph->vertices[node->vertices[2]];
+
+        area += (((double) b->x - a->x) * ((double) c->y - a->y)
+                 - ((double) b->y - a->y) * ((double) c->x - a->x)) / 2;
+    }
+
+    size = sqrt(area / graph->nodes_count);
+    if (!(size > 0))
+        size = (max_x - grid->min_x > max_y - grid->min_y)
+             ? max_x - grid->min_x : max_y - grid->min_y;
+    if (!(size > 0))
+        size = 1;
+
+    for (;;) {
+        const double columns = floor((max_x - grid->min_x) / size) + 1;
+        const double rows = floor((max_y - grid->min_y) / size) + 1;
+
+        if (columns * rows <= BAKE_GRID_CELLS_PER_NODE * graph->nodes_count + 1) {
+            grid->columns = columns;
+            grid->rows = rows;
+            break;
+        }
+        size *= 1.25;
+    }
+    grid->cell_size = size;
+    cells = (size_t) grid->columns * grid->rows;
+
+    graph->grid_first = calloc(cells + 1, sizeof graph->grid_first[0]);
+    assert(graph->grid_first != NULL);
+
+    for (i = 0; i < graph->nodes_count; i++)
+        bake_grid_cells(graph, &graph->nodes[i], i, &bake_grid_count);
+    for (i = 0; i < cells; i++)
+        graph->grid_first[i + 1] += graph->grid_first[i];
+    grid->entries_count = graph->grid_first[cells];
+
+    graph->grid_nodes = malloc((grid->entries_count + 1) * sizeof graph->grid_nodes[0]);
+    assert(graph->grid_nodes != NULL);
+
+    /* each cell's first walks along as it's filled, ending up at the next
+     * cell's, so shifting everything back a cell puts them right */
+    for (i = 0; i < graph->nodes_count; i++)
+        bake_grid_cells(graph, &graph->nodes[i], i, &bake_grid_fill);
+    memmove(&graph->grid_first[1], &graph->grid_first[0], cells * sizeof graph->grid_first[0]);
+    graph->grid_first[0] = 0;
+}
+
+/* turns a map into a trigraph: nodes in locality order, vertices in the
+ * order the nodes first use them (so unused ones drop out), every node
+ * wound the same way, neighbours linked across shared edges at
+ * COST_DEFAULT, and a grid to find nodes by.  fails if the result won't
+ * fit 16 bit indices */
+int mapc_bake(const struct mapc_map *map, struct trigraph *graph,
+              struct mapc_stats *stats)
+{
+    uint32_t *order, *remap;
+    size_t i, j;
+
+    memset(graph, 0, sizeof *graph);
+    memset(stats, 0, sizeof *stats);
+
+    if (map->nodes_count > BAKE_MAX_INDEX) {
+        fprintf(stderr, "mapc: map has %zu nodes, but a trigraph can only "
+                "index %zu\n", map->nodes_count, BAKE_MAX_INDEX);
+        return -1;
+    }
+
+    order = bake_order(map);
+
+    remap = malloc((map->verts_count + 1) * sizeof remap[0]);
+    assert(remap != NULL);
+    for (i = 0; i < map->verts_count; i++)
+        remap[i] = INDEX_NULL;
+
+    graph->nodes_count = map->nodes_count;
+    graph->nodes_size = graph->nodes_count * sizeof graph->nodes[0];
+    graph->nodes = malloc(graph->nodes_size + sizeof graph->nodes[0]);
+    assert(graph->nodes != NULL);
+
+    for (i = 0; i < map->nodes_count; i++) {
+        const uint32_t *v = &map->nodes[3 * order[i]];
+        struct trinode *node = &graph->nodes[i];
+        double winding;
+
+        for (j = 0; j < 3; j++) {
+            if (remap[v[j]] == INDEX_NULL) {
+                if (graph->vertices_count == BAKE_MAX_INDEX) {
+                    fprintf(stderr, "mapc: map uses more than %zu vertices, "
+                            "but a trigraph can only index that many\n",
+                            BAKE_MAX_INDEX);
+                    free(order);
+                    free(remap);
+                    mapc_trigraph_free(graph);
+                    return -1;
+                }
+                remap[v[j]] = graph->vertices_count++;
+            }
+            node->vertices[j] = remap[v[j]];
+            node->neighbours[j] = INDEX_NULL;
+            node->costs[j] = COST_BLOCKED;
+        }
+        node->__pad = 0;
+
+        /* same test as the editor, which should already have done this */
+        winding = ((double) map->xs[v[1]] - map->xs[v[0]])
+                    * ((double) map->ys[v[2]] - map->ys[v[0]])
+                - ((double) map->ys[v[1]] - map->ys[v[0]])
+                    * ((double) map->xs[v[2]] - map->xs[v[0]]);
+        if (winding < 0) {
+            const uint16_t t = node->vertices[1];
+            node->vertices[1] = node->vertices[2];
+            node->vertices[2] = t;
+        }
+    }
+
+    stats->unused_vertices = map->verts_count - graph->vertices_count;
+
+    graph->vertices_size = graph->vertices_count * sizeof graph->vertices[0];
+    graph->vertices = malloc(graph->vertices_size + sizeof graph->vertices[0]);
+    assert(graph->vertices != NULL);
+
+    for (i = 0; i < map->verts_count; i++) {
+        if (remap[i] == INDEX_NULL) continue;
+        graph->vertices[remap[i]].x = map->xs[i];
+        graph->vertices[remap[i]].y = map->ys[i];
+    }
+
+    bake_neighbours(graph, stats);
+    bake_grid(graph);
+
+    free(order);
+    free(remap);
+    return 0;
+}
+
+void mapc_trigraph_free(struct trigraph *graph)
+{
+    free(graph->nodes);
+    free(graph->vertices);
+    free(graph->grid_first);
+    free(graph->grid_nodes);
+    memset(graph, 0, sizeof *graph);
+}
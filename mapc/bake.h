@@ -0,0 +1,17 @@
+#ifndef MAPC_BAKE_H
+#define MAPC_BAKE_H
+
+#include "engine/trigraph.h"
+#include "mapc/read.h"
+
+struct mapc_stats {
+    size_t unused_vertices;     /* dropped, as no node uses them */
+    size_t boundary_edges;
+    size_t nonmanifold_edges;   /* shared by three or more nodes */
+};
+
+int mapc_bake(const struct mapc_map *map, struct trigraph *graph,
+              struct mapc_stats *stats);
+void mapc_trigraph_free(struct trigraph *graph);
+
+#endif
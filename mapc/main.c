@@ -0,0 +1,188 @@
+#include <config.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "engine/ch.h"
+#include "engine/hpa.h"
+#include "engine/trifile.h"
+#include "engine/trigraph.h"
+#include "mapc/bake.h"
+#include "mapc/read.h"
+
+/* bakes a map saved by the editor into a trigraph file for the engine.
+ *   mapc [-H] [-C] map.json [out.tri]
+ * with no output name, the input's extension is swapped for .tri.  the
+ * pathfinding hierarchies go alongside it: -H for out.hpa, -C for out.ch.
+ * with neither, only the hpa is baked, as the contraction hierarchy takes
+ * far longer (tens of seconds at 64k nodes, where the hpa takes a fifth of
+ * one).  one that isn't asked for is removed, so an old one isn't picked
+ * up instead.  the engine takes the ch over the hpa when both are there
+ */
+
+static char *swap_extension(const char *input, const char *extension)
+{
+    const char *dot = strrchr(input, '.'), *slash = strrchr(input, '/');
+    size_t len = strlen(input);
+    char *output;
+
+    if (dot && (!slash || dot > slash))
+        len = dot - input;
+
+    output = malloc(len + strlen(extension) + 1);
+    if (!output) return NULL;
+
+    memcpy(output, input, len);
+    strcpy(output + len, extension);
+    return output;
+}
+
+static int write_trigraph(const char *filename, struct trigraph *graph)
+{
+    const struct trigrid *grid = &graph->grid;
+    struct trifile_blob blobs[5];
+    size_t count = 2;
+
+    blobs[0].tag = TRIFILE_NODES;
+    blobs[0].data = graph->nodes;
+    blobs[0].size = graph->nodes_size;
+    blobs[1].tag = TRIFILE_VERTICES;
+    blobs[1].data = graph->vertices;
+    blobs[1].size = graph->vertices_size;
+
+    if (grid->columns) {
+        blobs[2].tag = TRIFILE_GRID;
+        blobs[2].data = grid;
+        blobs[2].size = sizeof *grid;
+        blobs[3].tag = TRIFILE_GRID_FIRST;
+        blobs[3].data = graph->grid_first;
+        blobs[3].size = ((size_t) grid->columns * grid->rows + 1)
+                      * sizeof graph->grid_first[0];
+        blobs[4].tag = TRIFILE_GRID_NODES;
+        blobs[4].data = graph->grid_nodes;
+        blobs[4].size = grid->entries_count * sizeof graph->grid_nodes[0];
+        count = 5;
+    }
+
+    return trifile_write(filename, graph->nodes_count, graph->vertices_count,
+                         blobs, count, &graph->check);
+}
+
+/* takes out a companion left by an earlier bake */
+static int remove_stale(const char *filename)
+{
+    if (remove(filename) == 0) {
+        printf("%s: removed\n", filename);
+        return 0;
+    }
+    if (errno == ENOENT)
+        return 0;
+
+    fprintf(stderr, "%s: %s\n", filename, strerror(errno));
+    return -1;
+}
+
+int main(int argc, char **argv)
+{
+    struct mapc_map map;
+    struct mapc_stats stats;
+    struct trigraph graph;
+    struct hpa hpa;
+    struct ch ch;
+    const char *input;
+    char *output, *hpa_output, *ch_output;
+    int i, bake_hpa = 0, bake_ch = 0, r;
+
+    for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+        if (!strcmp(argv[i], "-H"))
+            bake_hpa = 1;
+        else if (!strcmp(argv[i], "-C"))
+            bake_ch = 1;
+        else
+            break;
+    }
+    if (!bake_hpa && !bake_ch)
+        bake_hpa = 1;
+
+    if (argc - i < 1 || argc - i > 2 || argv[i][0] == '-') {
+        fprintf(stderr, "usage: %s [-H] [-C] map.json [out.tri]\n", argv[0]);
+        return 2;
+    }
+    input = argv[i];
+
+    output = (i + 1 < argc) ? strdup(argv[i + 1]) : swap_extension(input, ".tri");
+    hpa_output = output ? swap_extension(output, ".hpa") : NULL;
+    ch_output = output ? swap_extension(output, ".ch") : NULL;
+    if (!output || !hpa_output || !ch_output) {
+        fprintf(stderr, "%s\n", strerror(errno));
+        free(output);
+        free(hpa_output);
+        free(ch_output);
+        return 1;
+    }
+
+    if (mapc_read(input, &map) < 0) {
+        free(output);
+        free(hpa_output);
+        free(ch_output);
+        return 1;
+    }
+
+    r = mapc_bake(&map, &graph, &stats);
+    mapc_map_free(&map);
+    if (r < 0) {
+        fprintf(stderr, "mapc: not writing %s\n", output);
+        free(output);
+        free(hpa_output);
+        free(ch_output);
+        return 1;
+    }
+
+    r = write_trigraph(output, &graph);
+    if (r == 0) {
+        printf("%s: %zu nodes, %zu vertices", output,
+               graph.nodes_count, graph.vertices_count);
+        if (stats.unused_vertices)
+            printf(", dropped %zu unused vertices", stats.unused_vertices);
+        printf(", %zu boundary edges", stats.boundary_edges);
+        if (graph.grid.columns)
+            printf(", %ux%u grid with %.1f nodes a cell",
+                   graph.grid.columns, graph.grid.rows,
+                   (double) graph.grid.entries_count
+                       / ((double) graph.grid.columns * graph.grid.rows));
+        if (stats.nonmanifold_edges)
+            printf(", %zu non-manifold edges left unlinked", stats.nonmanifold_edges);
+        printf("\n");
+    }
+
+    if (r == 0 && !bake_hpa)
+        r = remove_stale(hpa_output);
+    else if (r == 0) {
+        r = hpa_build(&graph, HPA_CLUSTER_NODES, &hpa);
+        if (r == 0) {
+            r = hpa_write(hpa_output, &graph, &hpa);
+            if (r == 0)
+                printf("%s: %zu clusters, %zu entrances, %zu edges\n", hpa_output,
+                       hpa.clusters_count, hpa.abstract_count, hpa.edges_count);
+            hpa_free(&hpa);
+        }
+    }
+
+    if (r == 0 && !bake_ch)
+        r = remove_stale(ch_output);
+    else if (r == 0) {
+        ch_build(&graph, &ch);
+        r = ch_write(ch_output, &graph, &ch);
+        if (r == 0)
+            printf("%s: %zu shortcuts\n", ch_output, ch.shortcuts_count);
+        ch_free(&ch);
+    }
+
+    mapc_trigraph_free(&graph);
+    free(output);
+    free(hpa_output);
+    free(ch_output);
+    return r < 0 ? 1 : 0;
+}
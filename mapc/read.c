@@ -0,0 +1,86 @@
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mapc/read.h"
+#include "mapedit/mapfile.h"
+#include "mapedit/mapread.h"
+
+/* squeezes the gaps out of a map as the editor read it.  returns an error
+ * message, or NULL */
+static const char *read_compact(const struct mapread *in, struct mapc_map *map)
+{
+    uint32_t *remap;
+    size_t i, k;
+
+    remap = malloc((in->verts_count + 1) * sizeof remap[0]);
+    map->xs = malloc((in->verts_count + 1) * sizeof map->xs[0]);
+    map->ys = malloc((in->verts_count + 1) * sizeof map->ys[0]);
+    map->nodes = malloc((in->nodes_count + 1) * 3 * sizeof map->nodes[0]);
+    assert(remap != NULL && map->xs != NULL && map->ys != NULL && map->nodes != NULL);
+
+    for (i = 0; i < in->verts_count; i++) {
+        if (isnan(in->xs[i])) {
+            remap[i] = MAPFILE_NONE;
+            continue;
+        }
+        remap[i] = map->verts_count;
+        map->xs[map->verts_count] = in->xs[i];
+        map->ys[map->verts_count] = in->ys[i];
+        map->verts_count ++;
+    }
+
+    for (i = 0; i < in->nodes_count; i++) {
+        const uint32_t *v = &in->nodes[3 * i];
+        uint32_t *out = &map->nodes[3 * map->nodes_count];
+
+        if (v[0] == MAPFILE_NONE) continue;
+
+        /* the editor will take a vertex out at infinity, but nothing can
+         * be baked from one */
+        for (k = 0; k < 3; k++) {
+            if (!isfinite(in->xs[v[k]]) || !isfinite(in->ys[v[k]])) {
+                free(remap);
+                return "node has a vertex that isn't finite";
+            }
+            out[k] = remap[v[k]];
+        }
+        map->nodes_count ++;
+    }
+
+    free(remap);
+    return NULL;
+}
+
+/* reads a map saved by the editor, json or (ending in .bin) binary */
+int mapc_read(const char *filename, struct mapc_map *map)
+{
+    struct mapread in;
+    const char *error;
+
+    memset(map, 0, sizeof *map);
+
+    if (mapread_load(filename, &in) < 0)
+        return -1;
+
+    error = read_compact(&in, map);
+    mapread_free(&in);
+
+    if (error) {
+        fprintf(stderr, "%s: %s\n", filename, error);
+        mapc_map_free(map);
+        return -1;
+    }
+
+    return 0;
+}
+
+void mapc_map_free(struct mapc_map *map)
+{
+    free(map->xs);
+    free(map->ys);
+    free(map->nodes);
+    memset(map, 0, sizeof *map);
+}
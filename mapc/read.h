@@ -0,0 +1,20 @@
+#ifndef MAPC_READ_H
+#define MAPC_READ_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* an editor map with the deleted vertices and nodes squeezed out, so
+ * everything is numbered from zero */
+struct mapc_map {
+    size_t verts_count;
+    float *xs;
+    float *ys;
+    size_t nodes_count;
+    uint32_t *nodes;            /* three vertex indices per node */
+};
+
+int mapc_read(const char *filename, struct mapc_map *map);
+void mapc_map_free(struct mapc_map *map);
+
+#endif
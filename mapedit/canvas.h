@@ -8,12 +8,10 @@
 typedef unsigned node_id;
 typedef unsigned vertex_id;
 #define ID_NONE ((unsigned)(-1))
-#define ID_MAX  ((unsigned)(0xFFFE))
 
 struct vertex {
     vertex_id id;
-    fpoint p;
-    node_id *nodes;
+    size_t nodes_first; /* offset of this vertex's node ids in the pool */
     size_t nodes_alloc;
     size_t nodes_count;
 };
@@ -21,6 +19,7 @@ struct vertex {
 struct node {
     node_id id;
     vertex_id v[3];
+    node_id neighbours[3]; /* across the edge from v[i] to v[i + 1] */
 };
 
 void canvas_init(const char *filename);
@@ -29,13 +28,21 @@ void canvas_destroy(void);
 node_id canvas_add_node(vertex_id a, vertex_id b, vertex_id c);
 void canvas_delete_node(node_id id);
 node_id canvas_find_node_at(fpoint p);
+node_id canvas_find_node_from(fpoint p, node_id hint);
 const struct node *canvas_node(node_id id);
+node_id canvas_node_neighbour(node_id id, unsigned edge);
+
+void canvas_add_mesh(const fpoint *points, size_t n_points,
+                     const unsigned (*tris)[3], size_t n_tris,
+                     vertex_id *out_ids);
 
 vertex_id canvas_add_vertex(fpoint p);
 void canvas_delete_vertex(vertex_id id);
 void canvas_edit_vertex(vertex_id id, const fpoint *p_abs, const fvector *p_rel);
 vertex_id canvas_find_vertex_near(fpoint p, double snap, fpoint *out);
 const struct vertex *canvas_vertex(vertex_id id);
+fpoint canvas_vertex_point(vertex_id id);
+const node_id *canvas_vertex_nodes(vertex_id id, size_t *count);
 
 typedef void (canvas_find_vertex_cb)(vertex_id, void *);
 void canvas_find_vertices_within(fpoint a, fpoint b, canvas_find_vertex_cb *cb, void *rock);
@@ -43,8 +50,23 @@ void canvas_find_vertices_within(fpoint a, fpoint b, canvas_find_vertex_cb *cb,
 int canvas_handle_event(const SDL_Event *e);
 void canvas_render(SDL_Renderer *renderer);
 
+void canvas_begin_edit(void);
+void canvas_end_edit(void);
+int canvas_undo(void);
+int canvas_redo(void);
+
+void canvas_compact(void);
+
+enum canvas_save_state {
+    CANVAS_SAVE_IDLE = 0,
+    CANVAS_SAVE_RUNNING,
+    CANVAS_SAVE_FAILED,
+};
+
 int canvas_is_dirty(void);
 void canvas_save(const char *filename);
+void canvas_autosave(void);
+enum canvas_save_state canvas_save_state(void);
 void canvas_load(const char *filename);
 
 #endif
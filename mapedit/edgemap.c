@@ -0,0 +1,162 @@
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mapedit/canvas.h"
+#include "mapedit/edgemap.h"
+
+/* open-addressed hash map from an undirected edge (its two vertex ids,
+ * smallest first) to the nodes on either side of it.  an edge shared by
+ * more than two nodes isn't manifold, and only the first two to arrive
+ * are remembered.
+ */
+
+struct edge {
+    vertex_id lo;
+    vertex_id hi;
+    node_id n[2];
+};
+
+static struct edge *edges = NULL;
+static size_t edges_alloc = 0; /* power of two */
+static size_t edges_count = 0;
+
+#define EDGE_EMPTY(e) ((e)->lo == ID_NONE)
+
+static size_t edge_hash(vertex_id lo, vertex_id hi)
+{
+    uint64_t h = ((uint64_t) lo << 32) | hi;
+
+    h ^= h >> 33;
+    h *= UINT64_C(0xff51afd7ed558ccd);
+    h ^= h >> 33;
+    h *= UINT64_C(0xc4ceb9fe1a85ec53);
+    h ^= h >> 33;
+
+    return h & (edges_alloc - 1);
+}
+
+static struct edge *edge_slot(vertex_id lo, vertex_id hi)
+{
+    size_t i = edge_hash(lo, hi);
+
+    while (!EDGE_EMPTY(&edges[i])) {
+        if (edges[i].lo == lo && edges[i].hi == hi)
+            break;
+        i = (i + 1) & (edges_alloc - 1);
+    }
+
+    return &edges[i];
+}
+
+static void edges_resize(size_t n)
+{
+    struct edge *old_edges = edges;
+    size_t old_alloc = edges_alloc, i;
+
+    edges_alloc = n;
+    edges = malloc(edges_alloc * sizeof edges[0]);
+    assert(edges != NULL);
+    memset(edges, 0xff, edges_alloc * sizeof edges[0]); /* all ID_NONE */
+
+    for (i = 0; i < old_alloc; i++) {
+        if (EDGE_EMPTY(&old_edges[i])) continue;
+        *edge_slot(old_edges[i].lo, old_edges[i].hi) = old_edges[i];
+    }
+
+    free(old_edges);
+}
+
+void edgemap_reset(void)
+{
+    free(edges);
+    edges = NULL;
+    edges_alloc = edges_count = 0;
+}
+
+void edgemap_reserve(size_t n_edges)
+{
+    size_t want = edges_alloc ? edges_alloc : 1024;
+
+    /* keep the load factor at or below a half */
+    while (want < 2 * (edges_count + n_edges))
+        want += want;
+
+    if (want != edges_alloc)
+        edges_resize(want);
+}
+
+/* records that node id has the edge ab, returning the node already on
+ * the other side of it, if any */
+node_id edgemap_add(vertex_id a, vertex_id b, node_id id)
+{
+    const vertex_id lo = a < b ? a : b, hi = a < b ? b : a;
+    struct edge *e;
+
+    edgemap_reserve(1);
+
+    e = edge_slot(lo, hi);
+    if (EDGE_EMPTY(e)) {
+        e->lo = lo;
+        e->hi = hi;
+        e->n[0] = id;
+        e->n[1] = ID_NONE;
+        edges_count ++;
+        return ID_NONE;
+    }
+
+    if (e->n[0] == ID_NONE) {
+        e->n[0] = id;
+        return e->n[1];
+    }
+    if (e->n[1] == ID_NONE) {
+        e->n[1] = id;
+        return e->n[0];
+    }
+
+    return ID_NONE; /* not manifold */
+}
+
+/* forgets that node id has the edge ab, returning the node left on the
+ * other side of it, if any */
+node_id edgemap_remove(vertex_id a, vertex_id b, node_id id)
+{
+    const vertex_id lo = a < b ? a : b, hi = a < b ? b : a;
+    struct edge *e;
+    node_id other;
+    size_t i, j;
+
+    if (!edges_alloc) return ID_NONE;
+
+    e = edge_slot(lo, hi);
+    if (EDGE_EMPTY(e)) return ID_NONE;
+
+    if (e->n[0] == id) e->n[0] = ID_NONE;
+    else if (e->n[1] == id) e->n[1] = ID_NONE;
+
+    other = (e->n[0] != ID_NONE) ? e->n[0] : e->n[1];
+    if (other != ID_NONE) return other;
+
+    /* nobody left on this edge, delete it by shifting back any entries
+     * that probed past it */
+    i = e - edges;
+    j = i;
+    for (;;) {
+        size_t home;
+
+        j = (j + 1) & (edges_alloc - 1);
+        if (EDGE_EMPTY(&edges[j])) break;
+
+        home = edge_hash(edges[j].lo, edges[j].hi);
+        if ((j > i && (home <= i || home > j))
+            || (j < i && (home <= i && home > j))) {
+            edges[i] = edges[j];
+            i = j;
+        }
+    }
+    memset(&edges[i], 0xff, sizeof edges[i]);
+    edges_count --;
+
+    return ID_NONE;
+}
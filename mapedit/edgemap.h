@@ -0,0 +1,12 @@
+#ifndef MAPEDIT_EDGEMAP_H
+#define MAPEDIT_EDGEMAP_H
+
+#include "mapedit/canvas.h"
+
+void edgemap_reset(void);
+void edgemap_reserve(size_t n_edges);
+
+node_id edgemap_add(vertex_id a, vertex_id b, node_id id);
+node_id edgemap_remove(vertex_id a, vertex_id b, node_id id);
+
+#endif
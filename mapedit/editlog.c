@@ -0,0 +1,421 @@
+#include <config.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+
+#include "mapedit/editlog.h"
+
+/* crash recovery.  every change to the canvas is appended to
+ * "<map>.journal" as it's made, and whatever's in there is replayed over
+ * the map the next time it's loaded.  saving the map starts the journal
+ * afresh, keeping only what was edited after the save's snapshot.
+ *
+ * the header says which version of the map file (by size and mtime, to the
+ * nanosecond where stat has it) the records follow on from, so a journal
+ * that's out of step with its map is put aside rather than replayed over
+ * the wrong thing.
+ */
+
+#define EDITLOG_MAGIC       "sadjrnl\n"
+#define EDITLOG_VERSION     (2)
+#define EDITLOG_BYTE_ORDER  (0x01020304)
+
+#define EDITLOG_COMPACT     (0xFF)  /* record type, alongside enum delta_type */
+
+struct editlog_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t base_size;
+    int64_t base_mtime;
+    int64_t base_mtime_nsec;    /* or 0, where stat only has seconds */
+};
+
+struct editlog_record {
+    uint32_t type;
+    uint32_t id;
+    uint32_t data[3];       /* x and y as float bits, or three vertex ids */
+    uint32_t check;
+};
+
+static FILE *log_file = NULL;
+static char *log_mapname = NULL;
+static size_t log_size = 0;         /* bytes written, header and all */
+
+static char *journal_filename(const char *mapname, const char *suffix)
+{
+    const size_t alloc = strlen(mapname) + strlen(suffix) + 1;
+    char *filename = malloc(alloc);
+
+    assert(filename != NULL);
+    snprintf(filename, alloc, "%s%s", mapname, suffix);
+    return filename;
+}
+
+/* fnv-1a, enough to spot a record torn by a crash */
+static uint32_t record_check(const struct editlog_record *r)
+{
+    const unsigned char *p = (const unsigned char *) r;
+    uint32_t h = 2166136261u;
+    size_t i;
+
+    for (i = 0; i < offsetof(struct editlog_record, check); i++)
+        h = (h ^ p[i]) * 16777619u;
+    return h;
+}
+
+/* the header for a journal following on from mapname as it is on disk */
+static int header_for(const char *mapname, struct editlog_header *h)
+{
+    struct stat stat_buf;
+
+    if (stat(mapname, &stat_buf) < 0) return -1;
+
+    memset(h, 0, sizeof *h);
+    memcpy(h->magic, EDITLOG_MAGIC, sizeof h->magic);
+    h->version = EDITLOG_VERSION;
+    h->byte_order = EDITLOG_BYTE_ORDER;
+    h->base_size = stat_buf.st_size;
+    h->base_mtime = stat_buf.st_mtime;
+    /* two saves in the same second can be the same size */
+#if defined(HAVE_STRUCT_STAT_ST_MTIM)
+    h->base_mtime_nsec = stat_buf.st_mtim.tv_nsec;
+#elif defined(HAVE_STRUCT_STAT_ST_MTIMESPEC)
+    h->base_mtime_nsec = stat_buf.st_mtimespec.tv_nsec;
+#endif
+    return 0;
+}
+
+static int record_delta(const struct editlog_record *r, struct delta *delta)
+{
+    memset(delta, 0, sizeof *delta);
+    delta->type = r->type;
+    delta->id = r->id;
+
+    switch (r->type) {
+    case DELTA_VERTEX_ADD:
+    case DELTA_VERTEX_DELETE:
+        memcpy(&delta->u.p.x, &r->data[0], sizeof delta->u.p.x);
+        memcpy(&delta->u.p.y, &r->data[1], sizeof delta->u.p.y);
+        return 0;
+    case DELTA_VERTEX_MOVE:
+        memcpy(&delta->u.move.to.x, &r->data[0], sizeof delta->u.move.to.x);
+        memcpy(&delta->u.move.to.y, &r->data[1], sizeof delta->u.move.to.y);
+        delta->u.move.from = delta->u.move.to;
+        return 0;
+    case DELTA_NODE_ADD:
+    case DELTA_NODE_DELETE:
+        memcpy(delta->u.v, r->data, sizeof delta->u.v);
+        return 0;
+    case EDITLOG_COMPACT:
+        return 0;
+    }
+
+    return -1;
+}
+
+/* copies the whole of from to to, replacing it */
+static int copy_file(const char *from, const char *to)
+{
+    char buf[16 * 1024];
+    FILE *in, *out;
+    size_t n;
+    int err;
+
+    in = fopen(from, "rb");
+    if (!in) return -1;
+
+    out = fopen(to, "wb");
+    if (!out) {
+        fclose(in);
+        return -1;
+    }
+
+    while ((n = fread(buf, 1, sizeof buf, in)) > 0)
+        fwrite(buf, 1, n, out);
+
+    err = ferror(in) || ferror(out);
+    fclose(in);
+    if (fclose(out) || err) {
+        unlink(to);
+        return -1;
+    }
+    return 0;
+}
+
+/* replays whatever is in mapname's journal, if it follows on from the
+ * map file as it is on disk, then carries on appending to it.  cb gets
+ * each change in turn, and returns non-zero to reject one, which stops
+ * the replay there; the journal as it was is kept as <map>.journal.stale
+ * so the changes after it aren't lost.  returns the number of changes
+ * replayed */
+size_t editlog_open(const char *mapname, editlog_replay_cb *cb, void *rock)
+{
+    struct editlog_header want, have;
+    struct editlog_record r;
+    struct delta delta;
+    char *filename, *stale;
+    FILE *in;
+    size_t good = 0, count = 0;
+    int rejected = 0;
+
+    editlog_close();
+
+    if (header_for(mapname, &want) < 0) {
+        fprintf(stderr, "%s: %s\n", mapname, strerror(errno));
+        return 0;
+    }
+
+    filename = journal_filename(mapname, ".journal");
+
+    in = fopen(filename, "rb");
+    if (in) {
+        if (fread(&have, sizeof have, 1, in) == 1
+            && !memcmp(&have, &want, sizeof have)) {
+            good = sizeof have;
+
+            while (fread(&r, sizeof r, 1, in) == 1) {
+                if (r.check != record_check(&r)) break;
+
+                if (record_delta(&r, &delta) < 0
+                    || cb(r.type == EDITLOG_COMPACT ? NULL : &delta, rock)) {
+                    rejected = 1;
+                    break;
+                }
+
+                good += sizeof r;
+                count ++;
+            }
+        }
+        else {
+            /* not ours to replay, but don't throw it away either */
+            stale = journal_filename(mapname, ".journal.stale");
+            fprintf(stderr, "%s doesn't follow on from %s, moved it to %s\n",
+                    filename, mapname, stale);
+            rename(filename, stale);
+            free(stale);
+        }
+        fclose(in);
+
+        if (rejected) {
+            /* the rest may still be wanted, so keep it all before the
+             * journal is cut back to what was replayed */
+            stale = journal_filename(mapname, ".journal.stale");
+            if (copy_file(filename, stale) < 0) {
+                /* leave it be, and journal nothing this time round */
+                fprintf(stderr, "%s: unable to replay record %zu or copy it to %s\n",
+                        filename, count, stale);
+                free(stale);
+                free(filename);
+                return count;
+            }
+            fprintf(stderr, "%s: unable to replay record %zu, copied it to %s\n",
+                    filename, count, stale);
+            free(stale);
+        }
+    }
+
+    if (good) {
+        /* drop a record torn by a crash, if any */
+        if (truncate(filename, good) == 0)
+            log_file = fopen(filename, "ab");
+    }
+    else {
+        log_file = fopen(filename, "wb");
+        if (log_file && fwrite(&want, sizeof want, 1, log_file) != 1) {
+            fclose(log_file);
+            log_file = NULL;
+        }
+        good = sizeof want;
+    }
+
+    if (log_file) {
+        log_mapname = strdup(mapname);
+        assert(log_mapname != NULL);
+        log_size = good;
+        editlog_flush();
+    }
+    else {
+        fprintf(stderr, "unable to open %s: %s\n", filename, strerror(errno));
+    }
+
+    free(filename);
+    return count;
+}
+
+/* stops journalling.  the file is left behind for next time */
+void editlog_close(void)
+{
+    if (log_file) fclose(log_file);
+    log_file = NULL;
+
+    free(log_mapname);
+    log_mapname = NULL;
+    log_size = 0;
+}
+
+/* the map being journalled, or NULL if nothing is */
+const char *editlog_mapname(void)
+{
+    return log_mapname;
+}
+
+static void append(const struct editlog_record *r)
+{
+    if (!log_file) return;
+
+    if (fwrite(r, sizeof *r, 1, log_file) != 1) {
+        fprintf(stderr, "unable to write %s.journal: %s\n",
+                log_mapname, strerror(errno));
+        editlog_close();
+        return;
+    }
+
+    log_size += sizeof *r;
+}
+
+void editlog_record(const struct delta *delta)
+{
+    struct editlog_record r;
+
+    if (!log_file) return;
+
+    memset(&r, 0, sizeof r);
+    r.type = delta->type;
+    r.id = delta->id;
+
+    switch (delta->type) {
+    case DELTA_VERTEX_ADD:
+    case DELTA_VERTEX_DELETE:
+        memcpy(&r.data[0], &delta->u.p.x, sizeof r.data[0]);
+        memcpy(&r.data[1], &delta->u.p.y, sizeof r.data[1]);
+        break;
+    case DELTA_VERTEX_MOVE:
+        memcpy(&r.data[0], &delta->u.move.to.x, sizeof r.data[0]);
+        memcpy(&r.data[1], &delta->u.move.to.y, sizeof r.data[1]);
+        break;
+    case DELTA_NODE_ADD:
+    case DELTA_NODE_DELETE:
+        memcpy(r.data, delta->u.v, sizeof r.data);
+        break;
+    }
+
+    r.check = record_check(&r);
+    append(&r);
+}
+
+/* every id changes, so replay has to compact at the same point */
+void editlog_compact(void)
+{
+    struct editlog_record r;
+
+    if (!log_file) return;
+
+    memset(&r, 0, sizeof r);
+    r.type = EDITLOG_COMPACT;
+    r.check = record_check(&r);
+    append(&r);
+}
+
+/* hands what's been recorded to the os, which is enough to survive the
+ * editor crashing.  call once per edit */
+void editlog_flush(void)
+{
+    if (!log_file) return;
+
+    if (fflush(log_file)) {
+        fprintf(stderr, "unable to write %s.journal: %s\n",
+                log_mapname, strerror(errno));
+        editlog_close();
+    }
+}
+
+size_t editlog_size(void)
+{
+    return log_size;
+}
+
+/* the map has just been saved as mapname (possibly a new name), and the
+ * save has every change up to offset.  starts a new journal following on
+ * from the saved file, holding just what came after offset.  with
+ * EDITLOG_NONE, or nothing being journalled, it starts out empty */
+void editlog_rebase(const char *mapname, size_t offset)
+{
+    struct editlog_header header;
+    char *filename, *tmpname, *old_filename = NULL;
+    char buf[16 * 1024];
+    FILE *out = NULL, *in = NULL;
+    size_t size, n;
+    int err;
+
+    filename = journal_filename(mapname, ".journal");
+    tmpname = journal_filename(mapname, ".journal.tmp");
+
+    if (header_for(mapname, &header) < 0) goto fail;
+
+    out = fopen(tmpname, "wb");
+    if (!out) goto fail;
+
+    fwrite(&header, sizeof header, 1, out);
+    size = sizeof header;
+
+    if (log_file && offset != EDITLOG_NONE) {
+        assert(offset <= log_size);
+
+        old_filename = journal_filename(log_mapname, ".journal");
+        if (fflush(log_file)) goto fail;
+
+        in = fopen(old_filename, "rb");
+        if (!in || fseek(in, offset, SEEK_SET)) goto fail;
+
+        while ((n = fread(buf, 1, sizeof buf, in)) > 0) {
+            fwrite(buf, 1, n, out);
+            size += n;
+        }
+        if (ferror(in)) goto fail;
+        fclose(in);
+        in = NULL;
+    }
+
+    err = ferror(out);
+    if (fclose(out) || err) {
+        out = NULL;
+        goto fail;
+    }
+    out = NULL;
+
+    if (rename(tmpname, filename)) goto fail;
+
+    editlog_close();
+    if (old_filename && strcmp(old_filename, filename))
+        unlink(old_filename);
+
+    log_file = fopen(filename, "ab");
+    if (!log_file) goto fail;
+    log_mapname = strdup(mapname);
+    assert(log_mapname != NULL);
+    log_size = size;
+
+    free(old_filename);
+    free(tmpname);
+    free(filename);
+    return;
+
+fail:
+    fprintf(stderr, "unable to start %s: %s\n", filename, strerror(errno));
+    if (in) fclose(in);
+    if (out) fclose(out);
+    unlink(tmpname);
+    editlog_close();
+    free(old_filename);
+    free(tmpname);
+    free(filename);
+}
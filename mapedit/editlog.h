@@ -0,0 +1,24 @@
+#ifndef MAPEDIT_EDITLOG_H
+#define MAPEDIT_EDITLOG_H
+
+#include <stddef.h>
+
+#include "mapedit/journal.h"
+
+#define EDITLOG_NONE ((size_t)(-1))
+
+/* delta is NULL for a compaction */
+typedef int (editlog_replay_cb)(const struct delta *delta, void *rock);
+
+size_t editlog_open(const char *mapname, editlog_replay_cb *cb, void *rock);
+void editlog_close(void);
+const char *editlog_mapname(void);
+
+void editlog_record(const struct delta *delta);
+void editlog_compact(void);
+void editlog_flush(void);
+size_t editlog_size(void);
+
+void editlog_rebase(const char *mapname, size_t offset);
+
+#endif
@@ -0,0 +1,180 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mapedit/canvas.h"
+#include "mapedit/journal.h"
+
+/* undo/redo history, as a list of deltas split into groups (one group
+ * per user gesture).  groups before the cursor can be undone, groups
+ * after it redone.  recording anything new throws away whatever could
+ * have been redone.  the oldest groups are forgotten once the deltas
+ * take up more than JOURNAL_MAX_BYTES.
+ */
+
+#define JOURNAL_MAX_BYTES (16 * 1024 * 1024)
+
+static struct delta *deltas = NULL;
+static size_t deltas_alloc = 0;
+static size_t deltas_first = 0;         /* older ones have been dropped */
+static size_t deltas_count = 0;
+
+static size_t *groups = NULL;           /* index of each group's first delta */
+static size_t groups_alloc = 0;
+static size_t groups_first = 0;
+static size_t groups_count = 0;
+static size_t groups_done = 0;          /* the undo/redo cursor */
+
+static unsigned depth = 0;              /* of nested begin/end */
+static int group_open = 0;
+
+#define GROUP_END(g) ((g) + 1 < groups_count ? groups[(g) + 1] : deltas_count)
+
+void journal_reset(void)
+{
+    free(deltas);
+    deltas = NULL;
+    deltas_alloc = deltas_first = deltas_count = 0;
+
+    free(groups);
+    groups = NULL;
+    groups_alloc = groups_first = groups_count = groups_done = 0;
+
+    depth = 0;
+    group_open = 0;
+}
+
+/* forget the oldest groups while over budget, then slide everything
+ * down if enough space has been freed at the front */
+static void journal_trim(void)
+{
+    size_t i;
+
+    while ((deltas_count - deltas_first) * sizeof deltas[0] > JOURNAL_MAX_BYTES
+           && groups_first + 1 < groups_done) {
+        groups_first ++;
+        deltas_first = groups[groups_first];
+    }
+
+    if (deltas_first > deltas_count / 2) {
+        memmove(deltas, &deltas[deltas_first],
+                (deltas_count - deltas_first) * sizeof deltas[0]);
+        for (i = groups_first; i < groups_count; i++)
+            groups[i] -= deltas_first;
+        deltas_count -= deltas_first;
+        deltas_first = 0;
+    }
+
+    if (groups_first > groups_count / 2) {
+        memmove(groups, &groups[groups_first],
+                (groups_count - groups_first) * sizeof groups[0]);
+        groups_count -= groups_first;
+        groups_done -= groups_first;
+        groups_first = 0;
+    }
+}
+
+void journal_begin(void)
+{
+    depth ++;
+}
+
+void journal_end(void)
+{
+    assert(depth > 0);
+
+    if (--depth) return;
+
+    if (group_open) {
+        group_open = 0;
+        if (groups[groups_count - 1] == deltas_count) {
+            /* nothing was recorded after all */
+            groups_count --;
+            groups_done --;
+        }
+        journal_trim();
+    }
+}
+
+static void group_start(void)
+{
+    /* anything that could have been redone is gone now */
+    if (groups_done < groups_count) {
+        deltas_count = groups[groups_done];
+        groups_count = groups_done;
+    }
+
+    if (groups_count == groups_alloc) {
+        groups_alloc = groups_alloc ? groups_alloc * 2 : 256;
+        groups = realloc(groups, groups_alloc * sizeof groups[0]);
+        assert(groups != NULL);
+    }
+
+    groups[groups_count++] = deltas_count;
+    groups_done = groups_count;
+    group_open = 1;
+}
+
+void journal_record(const struct delta *delta)
+{
+    struct delta *last;
+
+    journal_begin();
+
+    if (!group_open)
+        group_start();
+
+    /* a drag records a move per mouse event, only keep the net move */
+    last = (deltas_count > groups[groups_count - 1]) ? &deltas[deltas_count - 1] : NULL;
+    if (last && delta->type == DELTA_VERTEX_MOVE
+        && last->type == DELTA_VERTEX_MOVE && last->id == delta->id) {
+        last->u.move.to = delta->u.move.to;
+        if (last->u.move.from.x == last->u.move.to.x
+            && last->u.move.from.y == last->u.move.to.y)
+            deltas_count --;
+        journal_end();
+        return;
+    }
+
+    if (deltas_count == deltas_alloc) {
+        deltas_alloc = deltas_alloc ? deltas_alloc * 2 : 1024;
+        deltas = realloc(deltas, deltas_alloc * sizeof deltas[0]);
+        assert(deltas != NULL);
+    }
+
+    deltas[deltas_count++] = *delta;
+
+    journal_end();
+}
+
+/* returns the deltas of the group to be undone (apply them backwards),
+ * or NULL if there's nothing to undo */
+const struct delta *journal_undo(size_t *count)
+{
+    size_t g;
+
+    assert(depth == 0);
+    assert(count != NULL);
+
+    if (groups_done <= groups_first) return NULL;
+
+    g = --groups_done;
+    *count = GROUP_END(g) - groups[g];
+    return &deltas[groups[g]];
+}
+
+/* returns the deltas of the group to be redone (apply them forwards),
+ * or NULL if there's nothing to redo */
+const struct delta *journal_redo(size_t *count)
+{
+    size_t g;
+
+    assert(depth == 0);
+    assert(count != NULL);
+
+    if (groups_done >= groups_count) return NULL;
+
+    g = groups_done++;
+    *count = GROUP_END(g) - groups[g];
+    return &deltas[groups[g]];
+}
@@ -0,0 +1,37 @@
+#ifndef MAPEDIT_JOURNAL_H
+#define MAPEDIT_JOURNAL_H
+
+#include <stddef.h>
+
+#include "mapedit/canvas.h"
+#include "mapedit/geometry.h"
+
+enum delta_type {
+    DELTA_VERTEX_ADD = 0,
+    DELTA_VERTEX_MOVE,
+    DELTA_VERTEX_DELETE,
+    DELTA_NODE_ADD,
+    DELTA_NODE_DELETE,
+};
+
+struct delta {
+    enum delta_type type;
+    unsigned id;
+    union {
+        fpoint p;                               /* vertex add/delete */
+        struct { fpoint from, to; } move;       /* vertex move */
+        vertex_id v[3];                         /* node add/delete */
+    } u;
+};
+
+void journal_reset(void);
+
+void journal_begin(void);
+void journal_end(void);
+
+void journal_record(const struct delta *delta);
+
+const struct delta *journal_undo(size_t *count);
+const struct delta *journal_redo(size_t *count);
+
+#endif
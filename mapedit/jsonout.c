@@ -0,0 +1,140 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "mapedit/jsonout.h"
+
+#define JSONOUT_INDENT (2)
+
+void jsonout_init(struct jsonout *j, FILE *out)
+{
+    memset(j, 0, sizeof *j);
+    j->out = out;
+    j->first = 1;
+}
+
+void jsonout_finish(struct jsonout *j)
+{
+    assert(j->depth == 0);
+    putc('\n', j->out);
+}
+
+static void newline(struct jsonout *j)
+{
+    unsigned i;
+
+    putc('\n', j->out);
+    for (i = 0; i < j->depth * JSONOUT_INDENT; i++)
+        putc(' ', j->out);
+}
+
+/* whatever goes in front of a value or key: separator, line break, indent */
+static void prefix(struct jsonout *j)
+{
+    if (j->after_key) {
+        j->after_key = 0;
+        return;
+    }
+
+    if (j->depth) {
+        if (!j->first) putc(',', j->out);
+        newline(j);
+    }
+
+    j->first = 0;
+}
+
+static void begin(struct jsonout *j, char c)
+{
+    prefix(j);
+    putc(c, j->out);
+    j->depth ++;
+    j->first = 1;
+}
+
+static void end(struct jsonout *j, char c)
+{
+    assert(j->depth > 0);
+    assert(!j->after_key);
+
+    j->depth --;
+    if (!j->first) newline(j);
+    putc(c, j->out);
+    j->first = 0;
+}
+
+void jsonout_begin_object(struct jsonout *j)
+{
+    begin(j, '{');
+}
+
+void jsonout_end_object(struct jsonout *j)
+{
+    end(j, '}');
+}
+
+void jsonout_begin_array(struct jsonout *j)
+{
+    begin(j, '[');
+}
+
+void jsonout_end_array(struct jsonout *j)
+{
+    end(j, ']');
+}
+
+/* n.b. keys aren't escaped, ours never need it */
+void jsonout_key(struct jsonout *j, const char *key)
+{
+    assert(!j->after_key);
+
+    prefix(j);
+    fprintf(j->out, "\"%s\": ", key);
+    j->after_key = 1;
+}
+
+void jsonout_key_uint(struct jsonout *j, unsigned long key)
+{
+    assert(!j->after_key);
+
+    prefix(j);
+    fprintf(j->out, "\"%lu\": ", key);
+    j->after_key = 1;
+}
+
+void jsonout_uint(struct jsonout *j, unsigned long value)
+{
+    prefix(j);
+    fprintf(j->out, "%lu", value);
+}
+
+/* same formatting as jansson: 17 significant digits, always a '.' or an
+ * exponent so it reads back as a real, and no '+' or leading zeros in
+ * the exponent */
+void jsonout_real(struct jsonout *j, double value)
+{
+    char buf[40], *start, *end;
+    size_t len;
+
+    len = snprintf(buf, sizeof buf - 2, "%.17g", value);
+    assert(len < sizeof buf - 2);
+
+    if (!strchr(buf, '.') && !strchr(buf, 'e')) {
+        buf[len++] = '.';
+        buf[len++] = '0';
+        buf[len] = '\0';
+    }
+
+    start = strchr(buf, 'e');
+    if (start) {
+        start ++;
+        end = start + 1;
+        if (*start == '-') start ++;
+        while (*end == '0') end ++;
+        if (end != start)
+            memmove(start, end, len + 1 - (end - buf));
+    }
+
+    prefix(j);
+    fputs(buf, j->out);
+}
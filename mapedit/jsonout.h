@@ -0,0 +1,30 @@
+#ifndef MAPEDIT_JSONOUT_H
+#define MAPEDIT_JSONOUT_H
+
+#include <stdio.h>
+
+/* writes json straight to a stream, laid out the same as jansson's
+ * json_dumps() with JSON_INDENT(2), so nothing has to be built up in
+ * memory first */
+struct jsonout {
+    FILE *out;
+    unsigned depth;
+    int first;      /* nothing written in the current object/array yet */
+    int after_key;  /* next value belongs to the key just written */
+};
+
+void jsonout_init(struct jsonout *j, FILE *out);
+void jsonout_finish(struct jsonout *j);
+
+void jsonout_begin_object(struct jsonout *j);
+void jsonout_end_object(struct jsonout *j);
+void jsonout_begin_array(struct jsonout *j);
+void jsonout_end_array(struct jsonout *j);
+
+void jsonout_key(struct jsonout *j, const char *key);
+void jsonout_key_uint(struct jsonout *j, unsigned long key);
+
+void jsonout_uint(struct jsonout *j, unsigned long value);
+void jsonout_real(struct jsonout *j, double value);
+
+#endif
@@ -0,0 +1,328 @@
+#include <assert.h>
+#include <float.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mapedit/jsonscan.h"
+
+#define JSONSCAN_MAX_DEPTH (64)
+
+void jsonscan_init(struct jsonscan *s, const char *buf)
+{
+    s->buf = s->p = buf;
+    s->error = NULL;
+}
+
+int jsonscan_fail(struct jsonscan *s, const char *error)
+{
+    if (!s->error) s->error = error;
+    return -1;
+}
+
+/* line number of the current position, for error messages */
+size_t jsonscan_line(const struct jsonscan *s)
+{
+    const char *p;
+    size_t line = 1;
+
+    for (p = s->buf; p < s->p; p++)
+        if (*p == '\n') line ++;
+
+    return line;
+}
+
+static char peek(struct jsonscan *s)
+{
+    while (*s->p == ' ' || *s->p == '\n' || *s->p == '\t' || *s->p == '\r')
+        s->p ++;
+
+    return *s->p;
+}
+
+static int expect(struct jsonscan *s, char c, const char *error)
+{
+    if (s->error) return -1;
+    if (peek(s) != c) return jsonscan_fail(s, error);
+    s->p ++;
+    return 0;
+}
+
+/* nothing but whitespace is allowed after the top level value */
+int jsonscan_end(struct jsonscan *s)
+{
+    if (s->error) return -1;
+    if (peek(s) != '\0') return jsonscan_fail(s, "trailing garbage");
+    return 0;
+}
+
+int jsonscan_begin_object(struct jsonscan *s)
+{
+    return expect(s, '{', "expected '{'");
+}
+
+/* returns 1 with the next member's key (its value is up next), or 0 once
+ * the closing brace has been consumed.  *index counts members so far, and
+ * must start at zero */
+int jsonscan_next_member(struct jsonscan *s, size_t *index,
+                         const char **key, size_t *key_len)
+{
+    if (s->error) return -1;
+
+    if (peek(s) == '}') {
+        s->p ++;
+        return 0;
+    }
+
+    if (*index && expect(s, ',', "expected ',' or '}'") < 0)
+        return -1;
+
+    if (jsonscan_string(s, key, key_len) < 0) return -1;
+    if (expect(s, ':', "expected ':'") < 0) return -1;
+
+    (*index) ++;
+    return 1;
+}
+
+int jsonscan_begin_array(struct jsonscan *s)
+{
+    return expect(s, '[', "expected '['");
+}
+
+/* returns 1 if another element is up next, or 0 once the closing bracket
+ * has been consumed.  *index must start at zero */
+int jsonscan_next_element(struct jsonscan *s, size_t *index)
+{
+    if (s->error) return -1;
+
+    if (peek(s) == ']') {
+        s->p ++;
+        return 0;
+    }
+
+    if (*index && expect(s, ',', "expected ',' or ']'") < 0)
+        return -1;
+
+    (*index) ++;
+    return 1;
+}
+
+/* n.b. escapes are checked but not decoded, *str points into the buffer */
+int jsonscan_string(struct jsonscan *s, const char **str, size_t *len)
+{
+    const char *start;
+
+    if (expect(s, '"', "expected string") < 0) return -1;
+
+    start = s->p;
+    while (*s->p != '"') {
+        if (*s->p == '\0' || (unsigned char) *s->p < 0x20)
+            return jsonscan_fail(s, "unterminated string");
+        if (*s->p == '\\') {
+            s->p ++;
+            if (*s->p == '\0') return jsonscan_fail(s, "unterminated string");
+        }
+        s->p ++;
+    }
+
+    *str = start;
+    *len = s->p - start;
+    s->p ++;
+    return 0;
+}
+
+int jsonscan_uint(struct jsonscan *s, unsigned long *value)
+{
+    unsigned long v = 0;
+
+    if (s->error) return -1;
+
+    if (peek(s) < '0' || *s->p > '9')
+        return jsonscan_fail(s, "expected unsigned integer");
+
+    while (*s->p >= '0' && *s->p <= '9') {
+        if (v > (ULONG_MAX - 9) / 10)
+            return jsonscan_fail(s, "integer out of range");
+        v = v * 10 + (*s->p++ - '0');
+    }
+
+    if (*s->p == '.' || *s->p == 'e' || *s->p == 'E')
+        return jsonscan_fail(s, "expected unsigned integer");
+
+    *value = v;
+    return 0;
+}
+
+int jsonscan_real(struct jsonscan *s, double *value)
+{
+    char *end;
+    char c;
+
+    if (s->error) return -1;
+
+    c = peek(s);
+    if (c != '-' && (c < '0' || c > '9'))
+        return jsonscan_fail(s, "expected number");
+
+    *value = strtod(s->p, &end);
+    if (end == s->p) return jsonscan_fail(s, "expected number");
+
+    s->p = end;
+    return 0;
+}
+
+/* reads a number straight to float.  usually this is one multiply or
+ * divide in double, which is close enough to round to the right float
+ * unless it lands right by a halfway point, in which case strtof()
+ * gets to decide */
+int jsonscan_float(struct jsonscan *s, float *value)
+{
+    static const double pow10[] = {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+    };
+    const char *p;
+    uint64_t m = 0, bits, low;
+    int digits = 0, exp = 0, e = 0, neg = 0, eneg = 0, exact = 1;
+    double d;
+    char *end;
+    char c;
+
+    if (s->error) return -1;
+
+    c = peek(s);
+    if (c != '-' && (c < '0' || c > '9'))
+        return jsonscan_fail(s, "expected number");
+
+    p = s->p;
+    if (*p == '-') {
+        neg = 1;
+        p++;
+    }
+
+    if (*p < '0' || *p > '9')
+        return jsonscan_fail(s, "expected number");
+
+    for (; *p >= '0' && *p <= '9'; p++) {
+        if (digits < 19) {
+            m = m * 10 + (*p - '0');
+            if (m) digits++;
+        }
+        else {
+            exact &= (*p == '0');
+            exp++;
+        }
+    }
+
+    if (*p == '.') {
+        for (p++; *p >= '0' && *p <= '9'; p++) {
+            if (digits < 19) {
+                m = m * 10 + (*p - '0');
+                if (m) digits++;
+                exp--;
+            }
+            else {
+                exact &= (*p == '0');
+            }
+        }
+    }
+
+    if (*p == 'e' || *p == 'E') {
+        p++;
+        if (*p == '-' || *p == '+') eneg = (*p++ == '-');
+        if (*p < '0' || *p > '9')
+            return jsonscan_fail(s, "expected number");
+        for (; *p >= '0' && *p <= '9'; p++)
+            if (e < 10000) e = e * 10 + (*p - '0');
+        exp += eneg ? -e : e;
+    }
+
+    if (exact && exp >= -22 && exp <= 22) {
+        d = (double) m;
+        d = (exp < 0) ? d / pow10[-exp] : d * pow10[exp];
+
+        /* the float halfway points are the doubles whose 29 bits beyond
+         * float precision are 1000...0; d is within a couple of ulps */
+        memcpy(&bits, &d, sizeof bits);
+        low = bits & ((UINT64_C(1) << 29) - 1);
+        if ((d == 0 || (d >= FLT_MIN && d <= FLT_MAX))
+            && (low + 4 < (UINT64_C(1) << 28) || low > (UINT64_C(1) << 28) + 4)) {
+            *value = neg ? -(float) d : (float) d;
+            s->p = p;
+            return 0;
+        }
+    }
+
+    *value = strtof(s->p, &end);
+    if (end != p) return jsonscan_fail(s, "expected number");
+
+    s->p = p;
+    return 0;
+}
+
+static int skip(struct jsonscan *s, unsigned depth)
+{
+    const char *str;
+    size_t len, i = 0;
+    double d;
+    int r;
+
+    if (s->error) return -1;
+    if (depth > JSONSCAN_MAX_DEPTH) return jsonscan_fail(s, "nested too deeply");
+
+    switch (peek(s)) {
+        case '{':
+            s->p ++;
+            while ((r = jsonscan_next_member(s, &i, &str, &len)) > 0)
+                if (skip(s, depth + 1) < 0) return -1;
+            return r;
+        case '[':
+            s->p ++;
+            while ((r = jsonscan_next_element(s, &i)) > 0)
+                if (skip(s, depth + 1) < 0) return -1;
+            return r;
+        case '"':
+            return jsonscan_string(s, &str, &len);
+        case 't':
+            if (strncmp(s->p, "true", 4)) break;
+            s->p += 4;
+            return 0;
+        case 'f':
+            if (strncmp(s->p, "false", 5)) break;
+            s->p += 5;
+            return 0;
+        case 'n':
+            if (strncmp(s->p, "null", 4)) break;
+            s->p += 4;
+            return 0;
+        default:
+            return jsonscan_real(s, &d);
+    }
+
+    return jsonscan_fail(s, "unexpected token");
+}
+
+/* skips over one value of any type */
+int jsonscan_skip(struct jsonscan *s)
+{
+    return skip(s, 0);
+}
+
+/* object keys that are decimal ids */
+int jsonscan_key_uint(const char *key, size_t key_len, unsigned long *value)
+{
+    unsigned long v = 0;
+    size_t i;
+
+    if (key_len == 0) return -1;
+
+    for (i = 0; i < key_len; i++) {
+        if (key[i] < '0' || key[i] > '9') return -1;
+        if (v > (ULONG_MAX - 9) / 10) return -1;
+        v = v * 10 + (key[i] - '0');
+    }
+
+    *value = v;
+    return 0;
+}
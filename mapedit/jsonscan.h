@@ -0,0 +1,36 @@
+#ifndef MAPEDIT_JSONSCAN_H
+#define MAPEDIT_JSONSCAN_H
+
+#include <stddef.h>
+
+/* pulls json apart in place, one token at a time, without building a
+ * tree.  the buffer must be NUL terminated.  functions return 0 on
+ * success (or 1/0 for the _next ones), and -1 after recording an error
+ * message; once that happens every later call fails too */
+struct jsonscan {
+    const char *buf;
+    const char *p;
+    const char *error;
+};
+
+void jsonscan_init(struct jsonscan *s, const char *buf);
+int jsonscan_end(struct jsonscan *s);
+int jsonscan_fail(struct jsonscan *s, const char *error);
+size_t jsonscan_line(const struct jsonscan *s);
+
+int jsonscan_begin_object(struct jsonscan *s);
+int jsonscan_next_member(struct jsonscan *s, size_t *index,
+                         const char **key, size_t *key_len);
+
+int jsonscan_begin_array(struct jsonscan *s);
+int jsonscan_next_element(struct jsonscan *s, size_t *index);
+
+int jsonscan_string(struct jsonscan *s, const char **str, size_t *len);
+int jsonscan_uint(struct jsonscan *s, unsigned long *value);
+int jsonscan_real(struct jsonscan *s, double *value);
+int jsonscan_float(struct jsonscan *s, float *value);
+int jsonscan_skip(struct jsonscan *s);
+
+int jsonscan_key_uint(const char *key, size_t key_len, unsigned long *value);
+
+#endif
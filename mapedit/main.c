@@ -7,6 +7,7 @@
 #include "mapedit/canvas.h"
 #include "mapedit/colour.h"
 #include "mapedit/prompt.h"
+#include "mapedit/selection.h"
 #include "mapedit/tools.h"
 #include "mapedit/view.h"
 
@@ -48,6 +49,7 @@ int main(int argc, char **argv)
 
         if (shutdown) break;
 
+        canvas_autosave();
         update_window_title();
 
         SDL_SetRenderDrawColor(renderer, C(main_background));
@@ -64,6 +66,7 @@ int main(int argc, char **argv)
 
     view_destroy();
     canvas_destroy();
+    selection_destroy();
     prompt_destroy();
 
     SDL_DestroyRenderer(renderer);
@@ -103,6 +106,13 @@ static void handle_events(void)
                 tool = &tools[TOOL_ARCDRAW];
                 tool->select();
                 break;
+            case SDLK_c:
+                tool->deselect();
+                selection_clear_nodes();
+                selection_clear_vertices();
+                canvas_compact();
+                tool->select();
+                break;
             case SDLK_d:
                 tool->deselect();
                 tool = &tools[TOOL_NODEDEL];
@@ -129,6 +139,15 @@ static void handle_events(void)
                 else
                     canvas_save(filename);
                 break;
+            case SDLK_u:
+                /* tools may be holding ids that undo/redo invalidates */
+                tool->deselect();
+                if (e.key.keysym.mod & KMOD_SHIFT)
+                    canvas_redo();
+                else
+                    canvas_undo();
+                tool->select();
+                break;
             case SDLK_v:
                 tool->deselect();
                 tool = &tools[TOOL_VERTSEL];
@@ -149,10 +168,24 @@ static void filename_ok(const char *text, void *context __attribute__((unused)))
 static void update_window_title(void)
 {
     char buf[1024] = {0};
+    const char *save_state;
+
+    switch (canvas_save_state()) {
+        case CANVAS_SAVE_RUNNING:
+            save_state = " (saving)";
+            break;
+        case CANVAS_SAVE_FAILED:
+            save_state = " (save failed)";
+            break;
+        default:
+            save_state = "";
+            break;
+    }
 
-    snprintf(buf, sizeof buf, "%s%s - %s",
+    snprintf(buf, sizeof buf, "%s%s%s - %s",
         (filename && canvas_is_dirty()) ? "*" : "",
         filename ? filename : "(untitled)",
+        save_state,
         tool ? tool->desc : "(no tool selected)");
 
     SDL_SetWindowTitle(window, buf);
@@ -0,0 +1,36 @@
+#ifndef MAPEDIT_MAPFILE_H
+#define MAPEDIT_MAPFILE_H
+
+#include <stdint.h>
+
+/* binary maps: a header, then each section padded out to 8 bytes.
+ *   float x[verts_count], y[verts_count]   NaN for deleted vertices
+ *   uint32 v[nodes_count][3]               MAPFILE_NONE for deleted nodes
+ * and with MAPFILE_HAS_ADJACENCY,
+ *   uint32 adj_counts[verts_count]         nodes per vertex
+ *   uint32 adj_ids[adj_count]              the nodes, vertex by vertex
+ * everything is in native byte order, which byte_order records */
+#define MAPFILE_MAGIC           "sadmap\r\n"
+#define MAPFILE_VERSION         (1)
+#define MAPFILE_BYTE_ORDER      (0x01020304)
+#define MAPFILE_HAS_ADJACENCY   (1u << 0)
+#define MAPFILE_NONE            ((uint32_t)(-1))    /* as ID_NONE */
+
+/* json maps saved before they had a "scale" are in pixels, at this many
+ * to the unit */
+#define MAPFILE_LEGACY_UNITPX   (128)
+
+struct mapfile_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t flags;
+    uint32_t verts_count;
+    uint32_t nodes_count;
+    uint32_t adj_count;
+    double scale;
+};
+
+#define PAD8(n) (((n) + 7) & ~(size_t) 7)
+
+#endif
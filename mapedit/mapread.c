@@ -0,0 +1,411 @@
+#include <assert.h>
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mapedit/jsonscan.h"
+#include "mapedit/mapfile.h"
+#include "mapedit/mapread.h"
+#include "mapedit/util.h"
+
+#define MAX(a,b) ((a) > (b) ? (a) : (b))
+
+/* what the json said, before it's checked and put in order */
+struct json_vertex {
+    uint32_t id;
+    float x, y;
+};
+
+struct json_node {
+    uint32_t id;
+    uint32_t v[3];
+};
+
+struct json_state {
+    struct jsonscan s;
+
+    struct json_vertex *verts;
+    size_t verts_alloc;
+    size_t verts_count;
+    uint32_t max_vert;
+
+    struct json_node *nodes;
+    size_t nodes_alloc;
+    size_t nodes_count;
+    uint32_t max_node;
+
+    int has_scale;
+    double scale;
+};
+
+static int json_id(struct json_state *js, const char *key, size_t key_len,
+                   uint32_t *id)
+{
+    unsigned long value;
+
+    if (jsonscan_key_uint(key, key_len, &value) < 0 || value >= MAPFILE_NONE)
+        return jsonscan_fail(&js->s, "bad id");
+
+    *id = value;
+    return 0;
+}
+
+static int json_vertex(struct json_state *js, uint32_t id)
+{
+    struct json_vertex *jv;
+    const char *key;
+    size_t key_len, i = 0, j;
+    float p[2];
+    int r, has_p = 0;
+
+    if (jsonscan_begin_object(&js->s) < 0) return -1;
+
+    while ((r = jsonscan_next_member(&js->s, &i, &key, &key_len)) > 0) {
+        if (key_len == 1 && key[0] == 'p') {
+            j = 0;
+            if (jsonscan_begin_array(&js->s) < 0) return -1;
+            while ((r = jsonscan_next_element(&js->s, &j)) > 0) {
+                if (j > 2) return jsonscan_fail(&js->s, "too many coordinates");
+                if (jsonscan_float(&js->s, &p[j - 1]) < 0) return -1;
+            }
+            if (r < 0) return -1;
+            if (j != 2) return jsonscan_fail(&js->s, "too few coordinates");
+            has_p = 1;
+        }
+        else {
+            /* including "nodes", which is rebuilt from the nodes instead */
+            if (jsonscan_skip(&js->s) < 0) return -1;
+        }
+    }
+    if (r < 0) return -1;
+    if (!has_p) return jsonscan_fail(&js->s, "vertex without \"p\"");
+
+    if (js->verts_count == js->verts_alloc) {
+        js->verts_alloc = js->verts_alloc ? js->verts_alloc * 2 : 1024;
+        js->verts = realloc(js->verts, js->verts_alloc * sizeof js->verts[0]);
+        assert(js->verts != NULL);
+    }
+
+    jv = &js->verts[js->verts_count++];
+    jv->id = id;
+    jv->x = p[0];
+    jv->y = p[1];
+    js->max_vert = (js->max_vert == MAPFILE_NONE) ? id : MAX(js->max_vert, id);
+    return 0;
+}
+
+static int json_node(struct json_state *js, uint32_t id)
+{
+    struct json_node *jn;
+    const char *key;
+    size_t key_len, i = 0, j;
+    unsigned long v[3];
+    int r, has_v = 0;
+
+    if (jsonscan_begin_object(&js->s) < 0) return -1;
+
+    while ((r = jsonscan_next_member(&js->s, &i, &key, &key_len)) > 0) {
+        if (key_len == 1 && key[0] == 'v') {
+            j = 0;
+            if (jsonscan_begin_array(&js->s) < 0) return -1;
+            while ((r = jsonscan_next_element(&js->s, &j)) > 0) {
+                if (j > 3) return jsonscan_fail(&js->s, "too many vertices");
+                if (jsonscan_uint(&js->s, &v[j - 1]) < 0) return -1;
+                if (v[j - 1] >= MAPFILE_NONE) return jsonscan_fail(&js->s, "bad id");
+            }
+            if (r < 0) return -1;
+            if (j != 3) return jsonscan_fail(&js->s, "too few vertices");
+            has_v = 1;
+        }
+        else {
+            if (jsonscan_skip(&js->s) < 0) return -1;
+        }
+    }
+    if (r < 0) return -1;
+    if (!has_v) return jsonscan_fail(&js->s, "node without \"v\"");
+
+    if (js->nodes_count == js->nodes_alloc) {
+        js->nodes_alloc = js->nodes_alloc ? js->nodes_alloc * 2 : 1024;
+        js->nodes = realloc(js->nodes, js->nodes_alloc * sizeof js->nodes[0]);
+        assert(js->nodes != NULL);
+    }
+
+    jn = &js->nodes[js->nodes_count++];
+    jn->id = id;
+    for (j = 0; j < 3; j++)
+        jn->v[j] = v[j];
+    js->max_node = (js->max_node == MAPFILE_NONE) ? id : MAX(js->max_node, id);
+    return 0;
+}
+
+/* the whole document, in a single pass */
+static int json_parse(struct json_state *js)
+{
+    const char *key, *ikey;
+    size_t key_len, ikey_len, i = 0, j;
+    uint32_t id = 0;
+    int r;
+
+    if (jsonscan_begin_object(&js->s) < 0) return -1;
+
+    while ((r = jsonscan_next_member(&js->s, &i, &key, &key_len)) > 0) {
+        if (key_len == 5 && !memcmp(key, "scale", 5)) {
+            if (jsonscan_real(&js->s, &js->scale) < 0) return -1;
+            js->has_scale = 1;
+        }
+        else if (key_len == 8 && !memcmp(key, "vertices", 8)) {
+            j = 0;
+            if (jsonscan_begin_object(&js->s) < 0) return -1;
+            while ((r = jsonscan_next_member(&js->s, &j, &ikey, &ikey_len)) > 0) {
+                if (json_id(js, ikey, ikey_len, &id) < 0) return -1;
+                if (json_vertex(js, id) < 0) return -1;
+            }
+            if (r < 0) return -1;
+        }
+        else if (key_len == 5 && !memcmp(key, "nodes", 5)) {
+            j = 0;
+            if (jsonscan_begin_object(&js->s) < 0) return -1;
+            while ((r = jsonscan_next_member(&js->s, &j, &ikey, &ikey_len)) > 0) {
+                if (json_id(js, ikey, ikey_len, &id) < 0) return -1;
+                if (json_node(js, id) < 0) return -1;
+            }
+            if (r < 0) return -1;
+        }
+        else {
+            if (jsonscan_skip(&js->s) < 0) return -1;
+        }
+    }
+    if (r < 0) return -1;
+
+    return jsonscan_end(&js->s);
+}
+
+/* puts everything in place by id, sizing each array once from the highest.
+ * returns an error message, or NULL if it all checked out */
+static const char *json_apply(const struct json_state *js, struct mapread *map)
+{
+    const double scale = js->has_scale ? 1.0 : 1.0 / MAPFILE_LEGACY_UNITPX;
+    float *xs, *ys;
+    uint32_t *nodes;
+    size_t i, j;
+
+    map->verts_count = (js->max_vert == MAPFILE_NONE) ? 0 : js->max_vert + 1;
+    map->nodes_count = (js->max_node == MAPFILE_NONE) ? 0 : js->max_node + 1;
+    map->scale = js->has_scale ? js->scale : MAPFILE_LEGACY_UNITPX;
+
+    xs = map->json_xs = malloc((map->verts_count + 1) * sizeof xs[0]);
+    ys = map->json_ys = malloc((map->verts_count + 1) * sizeof ys[0]);
+    nodes = map->json_nodes = malloc((map->nodes_count + 1) * 3 * sizeof nodes[0]);
+    assert(xs != NULL && ys != NULL && nodes != NULL);
+    map->xs = xs;
+    map->ys = ys;
+    map->nodes = nodes;
+
+    for (i = 0; i < map->verts_count; i++)
+        xs[i] = ys[i] = NAN;
+    for (i = 0; i < 3 * map->nodes_count; i++)
+        nodes[i] = MAPFILE_NONE;
+
+    /* json has no NaN, so a vertex that's there is never one */
+    for (i = 0; i < js->verts_count; i++) {
+        const struct json_vertex *jv = &js->verts[i];
+
+        if (!isnan(xs[jv->id]))
+            return "duplicate vertex id";
+
+        xs[jv->id] = jv->x * scale;
+        ys[jv->id] = jv->y * scale;
+    }
+
+    for (i = 0; i < js->nodes_count; i++) {
+        const struct json_node *jn = &js->nodes[i];
+
+        if (nodes[3 * jn->id] != MAPFILE_NONE)
+            return "duplicate node id";
+
+        for (j = 0; j < 3; j++) {
+            if (jn->v[j] >= map->verts_count || isnan(xs[jn->v[j]]))
+                return "node refers to missing vertex";
+            if (jn->v[j] == jn->v[(j + 1) % 3])
+                return "node refers to the same vertex twice";
+        }
+
+        memcpy(&nodes[3 * jn->id], jn->v, sizeof jn->v);
+    }
+
+    return NULL;
+}
+
+static int json_load(const char *filename, struct mapread *map)
+{
+    struct json_state js;
+    const char *error = NULL;
+    char *data;
+
+    data = read_file(filename, NULL);
+    if (!data) {
+        fprintf(stderr, "unable to read %s: %s\n", filename, strerror(errno));
+        return -1;
+    }
+
+    memset(&js, 0, sizeof js);
+    jsonscan_init(&js.s, data);
+    js.max_vert = MAPFILE_NONE;
+    js.max_node = MAPFILE_NONE;
+
+    if (json_parse(&js) < 0) {
+        fprintf(stderr, "%s:%zu: %s\n", filename, jsonscan_line(&js.s), js.s.error);
+        error = js.s.error;
+    }
+    else if ((error = json_apply(&js, map)) != NULL) {
+        fprintf(stderr, "%s: %s\n", filename, error);
+    }
+
+    free(js.verts);
+    free(js.nodes);
+    free(data);
+
+    return error ? -1 : 0;
+}
+
+/* finds the sections in a mapped .bin, and checks they hang together */
+static const char *binary_apply(const char *data, size_t size, struct mapread *map)
+{
+    struct mapfile_header header;
+    const float *xs, *ys;
+    const uint32_t *nodes, *adj_counts, *adj_ids;
+    size_t want, i, k, total, live_nodes = 0;
+
+    if (size < sizeof header) return "truncated header";
+    memcpy(&header, data, sizeof header);
+
+    if (memcmp(header.magic, MAPFILE_MAGIC, sizeof header.magic))
+        return "not a map file";
+    if (header.byte_order != MAPFILE_BYTE_ORDER)
+        return "map file has the wrong byte order";
+    if (header.version != MAPFILE_VERSION)
+        return "unsupported map file version";
+    if (header.verts_count >= MAPFILE_NONE || header.nodes_count >= MAPFILE_NONE)
+        return "too many vertices or nodes";
+
+    want = PAD8(sizeof header)
+         + 2 * PAD8((size_t) header.verts_count * sizeof xs[0])
+         + PAD8((size_t) header.nodes_count * 3 * sizeof nodes[0]);
+    if (header.flags & MAPFILE_HAS_ADJACENCY)
+        want += PAD8((size_t) header.verts_count * sizeof adj_counts[0])
+              + PAD8((size_t) header.adj_count * sizeof adj_ids[0]);
+    if (size != want) return "wrong size for its header";
+
+    xs = (const float *) (data + PAD8(sizeof header));
+    ys = (const float *) ((const char *) xs + PAD8(header.verts_count * sizeof xs[0]));
+    nodes = (const uint32_t *) ((const char *) ys + PAD8(header.verts_count * sizeof ys[0]));
+
+    for (i = 0; i < header.verts_count; i++) {
+        if (isnan(xs[i]) != isnan(ys[i]))
+            return "half-deleted vertex";
+    }
+
+    for (i = 0; i < header.nodes_count; i++) {
+        const uint32_t *v = &nodes[3 * i];
+
+        if (v[0] == MAPFILE_NONE) continue;
+
+        for (k = 0; k < 3; k++) {
+            if (v[k] >= header.verts_count || isnan(xs[v[k]]))
+                return "node refers to missing vertex";
+            if (v[k] == v[(k + 1) % 3])
+                return "node refers to the same vertex twice";
+        }
+        live_nodes ++;
+    }
+
+    map->verts_count = header.verts_count;
+    map->xs = xs;
+    map->ys = ys;
+    map->nodes_count = header.nodes_count;
+    map->nodes = nodes;
+    map->scale = header.scale;
+    if (!(header.flags & MAPFILE_HAS_ADJACENCY)) return NULL;
+
+    adj_counts = (const uint32_t *) ((const char *) nodes
+                    + PAD8(header.nodes_count * 3 * sizeof nodes[0]));
+    adj_ids = (const uint32_t *) ((const char *) adj_counts
+                    + PAD8(header.verts_count * sizeof adj_counts[0]));
+
+    /* each entry really is one of its vertex's nodes, and there's one for
+     * every corner of every node */
+    for (i = total = 0; i < header.verts_count; i++) {
+        if (adj_counts[i] && isnan(xs[i]))
+            return "deleted vertex has nodes";
+        if (adj_counts[i] > header.adj_count - total)
+            return "adjacency doesn't match nodes";
+
+        for (k = total; k < total + adj_counts[i]; k++) {
+            const uint32_t *v;
+
+            if (adj_ids[k] >= header.nodes_count)
+                return "adjacency doesn't match nodes";
+            v = &nodes[3 * adj_ids[k]];
+            if (v[0] == MAPFILE_NONE || (v[0] != i && v[1] != i && v[2] != i))
+                return "adjacency doesn't match nodes";
+        }
+        total += adj_counts[i];
+    }
+    if (total != header.adj_count || total != 3 * live_nodes)
+        return "adjacency doesn't match nodes";
+
+    map->adj_counts = adj_counts;
+    map->adj_ids = adj_ids;
+    map->adj_count = total;
+    return NULL;
+}
+
+static int binary_load(const char *filename, struct mapread *map)
+{
+    const char *data, *error;
+    size_t size;
+
+    data = map_file(filename, &size);
+    if (!data) {
+        fprintf(stderr, "unable to read %s: %s\n", filename, strerror(errno));
+        return -1;
+    }
+
+    map->data = data;
+    map->size = size;
+
+    error = binary_apply(data, size, map);
+    if (error)
+        fprintf(stderr, "%s: %s\n", filename, error);
+
+    return error ? -1 : 0;
+}
+
+/* returns -1, having said why, if the file can't be read or doesn't check
+ * out */
+int mapread_load(const char *filename, struct mapread *map)
+{
+    int r;
+
+    memset(map, 0, sizeof *map);
+
+    if (has_extension(filename, ".bin"))
+        r = binary_load(filename, map);
+    else
+        r = json_load(filename, map);
+
+    if (r < 0) mapread_free(map);
+    return r;
+}
+
+void mapread_free(struct mapread *map)
+{
+    free(map->json_xs);
+    free(map->json_ys);
+    free(map->json_nodes);
+    if (map->data)
+        unmap_file(map->data, map->size);
+    memset(map, 0, sizeof *map);
+}
@@ -0,0 +1,40 @@
+#ifndef MAPEDIT_MAPREAD_H
+#define MAPEDIT_MAPREAD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* reads a map the editor saved, json or (ending in .bin) binary, for the
+ * editor and mapc alike.  everything comes out indexed by the ids the
+ * editor gave it, with the gaps left in, and checked as far as the file
+ * goes: ids are unique, each node has three different vertices that are
+ * there, and a saved adjacency matches the nodes.
+ *
+ * the arrays may point straight into a mapped .bin, so they're only good
+ * until mapread_free */
+
+struct mapread {
+    size_t verts_count;         /* the highest vertex id, plus one */
+    const float *xs, *ys;       /* in units, NaN where there's no vertex */
+
+    size_t nodes_count;
+    const uint32_t *nodes;      /* three vertex ids a node, MAPFILE_NONE
+                                 * first where there's no node */
+
+    const uint32_t *adj_counts; /* as in mapfile.h, or NULL if not saved */
+    const uint32_t *adj_ids;
+    size_t adj_count;
+
+    double scale;               /* the pixels to a unit it was saved at */
+
+    /* what mapread_free lets go of */
+    float *json_xs, *json_ys;
+    uint32_t *json_nodes;
+    const void *data;
+    size_t size;
+};
+
+int mapread_load(const char *filename, struct mapread *map);
+void mapread_free(struct mapread *map);
+
+#endif
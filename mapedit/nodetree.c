@@ -0,0 +1,526 @@
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mapedit/canvas.h"
+#include "mapedit/geometry.h"
+#include "mapedit/nodetree.h"
+
+/* dynamic bounding volume hierarchy over node bounding boxes.  leaves
+ * are inserted next to whichever sibling grows the tree's total
+ * perimeter least, and the path back to the root is rebalanced with
+ * avl-style rotations, so the height stays logarithmic no matter what
+ * order nodes are added and removed in.
+ */
+
+#define TREE_NULL ((unsigned)(-1))
+#define TREE_STACK_DEPTH (128)
+
+#define MIN(a,b) ((a) < (b) ? (a) : (b))
+#define MAX(a,b) ((a) > (b) ? (a) : (b))
+
+struct aabb {
+    fpoint tl;
+    fpoint br;
+};
+
+struct treenode {
+    struct aabb box;
+    unsigned parent; /* doubles as the free list link */
+    unsigned child1;
+    unsigned child2;
+    int height; /* leaf = 0, free = -1 */
+    node_id leaf;
+};
+
+static struct treenode *tree = NULL;
+static size_t tree_alloc = 0;
+static unsigned tree_root = TREE_NULL;
+static unsigned tree_free = TREE_NULL;
+
+/* node_id -> leaf index */
+static unsigned *leaves = NULL;
+static size_t leaves_alloc = 0;
+
+static struct aabb combine(const struct aabb *a, const struct aabb *b)
+{
+    struct aabb result = {
+        { MIN(a->tl.x, b->tl.x), MIN(a->tl.y, b->tl.y) },
+        { MAX(a->br.x, b->br.x), MAX(a->br.y, b->br.y) },
+    };
+    return result;
+}
+
+static double perimeter(const struct aabb *a)
+{
+    return 2.0 * (((double) a->br.x - a->tl.x) + ((double) a->br.y - a->tl.y));
+}
+
+static int contains(const struct aabb *a, const struct aabb *b)
+{
+    return a->tl.x <= b->tl.x && a->tl.y <= b->tl.y
+        && a->br.x >= b->br.x && a->br.y >= b->br.y;
+}
+
+static int is_leaf(unsigned i)
+{
+    return tree[i].child1 == TREE_NULL;
+}
+
+/* grows the pool to at least n entries, putting the new ones on the
+ * front of the free list */
+static void tree_grow(size_t n)
+{
+    size_t old_alloc = tree_alloc, i;
+
+    if (!tree_alloc) tree_alloc = 256;
+    while (tree_alloc < n)
+        tree_alloc += tree_alloc;
+    if (tree_alloc == old_alloc) return;
+
+    tree = realloc(tree, tree_alloc * sizeof tree[0]);
+    assert(tree != NULL);
+
+    for (i = old_alloc; i < tree_alloc; i++) {
+        memset(&tree[i], 0, sizeof tree[i]);
+        tree[i].parent = (i + 1 < tree_alloc) ? i + 1 : tree_free;
+        tree[i].height = -1;
+    }
+    tree_free = old_alloc;
+}
+
+static unsigned treenode_alloc(void)
+{
+    unsigned i;
+
+    if (tree_free == TREE_NULL)
+        tree_grow(tree_alloc + 1);
+
+    i = tree_free;
+    tree_free = tree[i].parent;
+
+    tree[i].parent = tree[i].child1 = tree[i].child2 = TREE_NULL;
+    tree[i].height = 0;
+    tree[i].leaf = ID_NONE;
+
+    return i;
+}
+
+static void treenode_free(unsigned i)
+{
+    tree[i].parent = tree_free;
+    tree[i].height = -1;
+    tree_free = i;
+}
+
+static void replace_child(unsigned parent, unsigned old_child, unsigned new_child)
+{
+    if (parent == TREE_NULL)
+        tree_root = new_child;
+    else if (tree[parent].child1 == old_child)
+        tree[parent].child1 = new_child;
+    else
+        tree[parent].child2 = new_child;
+}
+
+/* rotates a's taller grandchild up if a is out of balance, returning
+ * whichever node is now at a's old position */
+static unsigned balance(unsigned ia)
+{
+    struct treenode *a = &tree[ia];
+    unsigned ib, ic;
+    int bal;
+
+    if (is_leaf(ia) || a->height < 2)
+        return ia;
+
+    ib = a->child1;
+    ic = a->child2;
+    bal = tree[ic].height - tree[ib].height;
+
+    if (bal > 1) {
+        struct treenode *b = &tree[ib], *c = &tree[ic];
+        unsigned i_f = c->child1, ig = c->child2;
+        struct treenode *f = &tree[i_f], *g = &tree[ig];
+
+        c->child1 = ia;
+        c->parent = a->parent;
+        a->parent = ic;
+        replace_child(c->parent, ia, ic);
+
+        if (f->height > g->height) {
+            c->child2 = i_f;
+            a->child2 = ig;
+            g->parent = ia;
+            a->box = combine(&b->box, &g->box);
+            c->box = combine(&a->box, &f->box);
+            a->height = 1 + MAX(b->height, g->height);
+            c->height = 1 + MAX(a->height, f->height);
+        }
+        else {
+            c->child2 = ig;
+            a->child2 = i_f;
+            f->parent = ia;
+            a->box = combine(&b->box, &f->box);
+            c->box = combine(&a->box, &g->box);
+            a->height = 1 + MAX(b->height, f->height);
+            c->height = 1 + MAX(a->height, g->height);
+        }
+
+        return ic;
+    }
+
+    if (bal < -1) {
+        struct treenode *b = &tree[ib], *c = &tree[ic];
+        unsigned id = b->child1, ie = b->child2;
+        struct treenode *d = &tree[id], *e = &tree[ie];
+
+        b->child1 = ia;
+        b->parent = a->parent;
+        a->parent = ib;
+        replace_child(b->parent, ia, ib);
+
+        if (d->height > e->height) {
+            b->child2 = id;
+            a->child1 = ie;
+            e->parent = ia;
+            a->box = combine(&c->box, &e->box);
+            b->box = combine(&a->box, &d->box);
+            a->height = 1 + MAX(c->height, e->height);
+            b->height = 1 + MAX(a->height, d->height);
+        }
+        else {
+            b->child2 = ie;
+            a->child1 = id;
+            d->parent = ia;
+            a->box = combine(&c->box, &d->box);
+            b->box = combine(&a->box, &e->box);
+            a->height = 1 + MAX(c->height, d->height);
+            b->height = 1 + MAX(a->height, e->height);
+        }
+
+        return ib;
+    }
+
+    return ia;
+}
+
+static void refit_from(unsigned i)
+{
+    while (i != TREE_NULL) {
+        unsigned c1, c2;
+
+        i = balance(i);
+
+        c1 = tree[i].child1;
+        c2 = tree[i].child2;
+        tree[i].height = 1 + MAX(tree[c1].height, tree[c2].height);
+        tree[i].box = combine(&tree[c1].box, &tree[c2].box);
+
+        i = tree[i].parent;
+    }
+}
+
+static void leaf_insert(unsigned leaf)
+{
+    const struct aabb leaf_box = tree[leaf].box;
+    const struct aabb *box = &leaf_box;
+    unsigned i, sibling, old_parent, new_parent;
+
+    if (tree_root == TREE_NULL) {
+        tree_root = leaf;
+        tree[leaf].parent = TREE_NULL;
+        return;
+    }
+
+    /* descend towards the cheapest sibling */
+    i = tree_root;
+    while (!is_leaf(i)) {
+        unsigned c1 = tree[i].child1, c2 = tree[i].child2;
+        struct aabb combined = combine(&tree[i].box, box);
+        double area = perimeter(&tree[i].box);
+        double combined_area = perimeter(&combined);
+        double cost = 2.0 * combined_area;
+        double inheritance = 2.0 * (combined_area - area);
+        double cost1, cost2;
+        struct aabb tmp;
+
+        tmp = combine(box, &tree[c1].box);
+        cost1 = perimeter(&tmp) + inheritance;
+        if (!is_leaf(c1)) cost1 -= perimeter(&tree[c1].box);
+
+        tmp = combine(box, &tree[c2].box);
+        cost2 = perimeter(&tmp) + inheritance;
+        if (!is_leaf(c2)) cost2 -= perimeter(&tree[c2].box);
+
+        if (cost < cost1 && cost < cost2)
+            break;
+
+        i = (cost1 < cost2) ? c1 : c2;
+    }
+    sibling = i;
+
+    /* n.b. treenode_alloc may move the tree, so no pointers across it */
+    new_parent = treenode_alloc();
+    old_parent = tree[sibling].parent;
+    tree[new_parent].parent = old_parent;
+    tree[new_parent].box = combine(&tree[sibling].box, &tree[leaf].box);
+    tree[new_parent].height = tree[sibling].height + 1;
+    tree[new_parent].child1 = sibling;
+    tree[new_parent].child2 = leaf;
+    tree[sibling].parent = new_parent;
+    tree[leaf].parent = new_parent;
+    replace_child(old_parent, sibling, new_parent);
+
+    refit_from(new_parent);
+}
+
+static void leaf_remove(unsigned leaf)
+{
+    unsigned parent, grandparent, sibling;
+
+    if (leaf == tree_root) {
+        tree_root = TREE_NULL;
+        return;
+    }
+
+    parent = tree[leaf].parent;
+    grandparent = tree[parent].parent;
+    sibling = (tree[parent].child1 == leaf) ? tree[parent].child2
+                                            : tree[parent].child1;
+
+    replace_child(grandparent, parent, sibling);
+    tree[sibling].parent = grandparent;
+    treenode_free(parent);
+
+    refit_from(grandparent);
+}
+
+void nodetree_reset(void)
+{
+    free(tree);
+    tree = NULL;
+    tree_alloc = 0;
+    tree_root = tree_free = TREE_NULL;
+
+    free(leaves);
+    leaves = NULL;
+    leaves_alloc = 0;
+}
+
+static void leaves_ensure(node_id id)
+{
+    size_t i, old_alloc = leaves_alloc;
+
+    if (id < leaves_alloc) return;
+
+    if (!leaves_alloc) leaves_alloc = 256;
+    while (leaves_alloc <= id)
+        leaves_alloc += leaves_alloc;
+
+    leaves = realloc(leaves, leaves_alloc * sizeof leaves[0]);
+    assert(leaves != NULL);
+
+    for (i = old_alloc; i < leaves_alloc; i++)
+        leaves[i] = TREE_NULL;
+}
+
+void nodetree_insert(node_id id, fpoint tl, fpoint br)
+{
+    unsigned leaf;
+
+    assert(id != ID_NONE);
+    leaves_ensure(id);
+    assert(leaves[id] == TREE_NULL);
+
+    leaf = treenode_alloc();
+    tree[leaf].box.tl = tl;
+    tree[leaf].box.br = br;
+    tree[leaf].leaf = id;
+    leaves[id] = leaf;
+
+    leaf_insert(leaf);
+}
+
+struct build_item {
+    uint32_t code;
+    unsigned leaf;
+};
+
+/* spreads the low 16 bits of x out to the even bits */
+static uint32_t morton_spread(uint32_t x)
+{
+    x &= 0xffff;
+    x = (x | (x << 8)) & 0x00ff00ff;
+    x = (x | (x << 4)) & 0x0f0f0f0f;
+    x = (x | (x << 2)) & 0x33333333;
+    x = (x | (x << 1)) & 0x55555555;
+    return x;
+}
+
+/* lsd radix sort on code, a byte at a time */
+static void sort_items(struct build_item *items, size_t n)
+{
+    struct build_item *tmp, *src = items, *dst, *swap;
+    size_t counts[256], i;
+    unsigned shift;
+
+    tmp = malloc(n * sizeof tmp[0]);
+    assert(tmp != NULL);
+    dst = tmp;
+
+    for (shift = 0; shift < 32; shift += 8) {
+        size_t total = 0;
+
+        memset(counts, 0, sizeof counts);
+        for (i = 0; i < n; i++)
+            counts[(src[i].code >> shift) & 0xff]++;
+        for (i = 0; i < 256; i++) {
+            size_t c = counts[i];
+            counts[i] = total;
+            total += c;
+        }
+        for (i = 0; i < n; i++)
+            dst[counts[(src[i].code >> shift) & 0xff]++] = src[i];
+
+        swap = src;
+        src = dst;
+        dst = swap;
+    }
+
+    /* an even number of passes, so the result is back in items */
+    assert(src == items);
+    free(tmp);
+}
+
+/* splits the sorted leaves down the middle, so subtree sizes differ by
+ * at most one and the result is already avl balanced */
+static unsigned build(const struct build_item *items, size_t n)
+{
+    unsigned c1, c2, i;
+
+    if (n == 1) return items[0].leaf;
+
+    c1 = build(items, n / 2);
+    c2 = build(items + n / 2, n - n / 2);
+
+    i = treenode_alloc();
+    tree[i].child1 = c1;
+    tree[i].child2 = c2;
+    tree[i].box = combine(&tree[c1].box, &tree[c2].box);
+    tree[i].height = 1 + MAX(tree[c1].height, tree[c2].height);
+    tree[c1].parent = tree[c2].parent = i;
+
+    return i;
+}
+
+/* builds the whole tree at once from an empty one, which is much faster
+ * than inserting nodes one by one.  leaves are ordered along a z-order
+ * curve through their centres, so neighbouring leaves share subtrees */
+void nodetree_build(const node_id *ids, size_t n, nodetree_bounds_cb *bounds)
+{
+    struct build_item *items;
+    struct aabb extent;
+    float sx, sy;
+    size_t k;
+
+    assert(tree_root == TREE_NULL);
+
+    if (!n) return;
+
+    items = malloc(n * sizeof items[0]);
+    assert(items != NULL);
+
+    tree_grow(2 * n);
+
+    for (k = 0; k < n; k++) {
+        const node_id id = ids[k];
+        unsigned leaf;
+
+        assert(id != ID_NONE);
+        leaves_ensure(id);
+        assert(leaves[id] == TREE_NULL);
+
+        leaf = treenode_alloc();
+        bounds(id, &tree[leaf].box.tl, &tree[leaf].box.br);
+        tree[leaf].leaf = id;
+        leaves[id] = leaf;
+        items[k].leaf = leaf;
+
+        extent = k ? combine(&extent, &tree[leaf].box) : tree[leaf].box;
+    }
+
+    sx = (extent.br.x > extent.tl.x) ? 65535.0f / (extent.br.x - extent.tl.x) : 0;
+    sy = (extent.br.y > extent.tl.y) ? 65535.0f / (extent.br.y - extent.tl.y) : 0;
+
+    for (k = 0; k < n; k++) {
+        const struct aabb *box = &tree[items[k].leaf].box;
+        uint32_t qx = ((box->tl.x + box->br.x) * 0.5f - extent.tl.x) * sx;
+        uint32_t qy = ((box->tl.y + box->br.y) * 0.5f - extent.tl.y) * sy;
+
+        items[k].code = morton_spread(qx) | (morton_spread(qy) << 1);
+    }
+
+    sort_items(items, n);
+
+    tree_root = build(items, n);
+    tree[tree_root].parent = TREE_NULL;
+
+    free(items);
+}
+
+void nodetree_remove(node_id id)
+{
+    unsigned leaf;
+
+    if (id >= leaves_alloc || leaves[id] == TREE_NULL) return;
+
+    leaf = leaves[id];
+    leaf_remove(leaf);
+    treenode_free(leaf);
+    leaves[id] = TREE_NULL;
+}
+
+void nodetree_update(node_id id, fpoint tl, fpoint br)
+{
+    struct aabb box = { tl, br };
+    unsigned leaf;
+
+    assert(id < leaves_alloc && leaves[id] != TREE_NULL);
+    leaf = leaves[id];
+
+    if (contains(&tree[leaf].box, &box) && contains(&box, &tree[leaf].box))
+        return;
+
+    leaf_remove(leaf);
+    tree[leaf].box = box;
+    leaf_insert(leaf);
+}
+
+/* calls cb for every node whose bounding box contains p.  candidates
+ * still need an exact test */
+void nodetree_find_at(fpoint p, nodetree_find_cb *cb, void *rock)
+{
+    unsigned stack[TREE_STACK_DEPTH];
+    size_t top = 0;
+
+    if (!cb || tree_root == TREE_NULL) return;
+
+    stack[top++] = tree_root;
+    while (top) {
+        const struct treenode *t = &tree[stack[--top]];
+
+        if (p.x < t->box.tl.x || p.x > t->box.br.x) continue;
+        if (p.y < t->box.tl.y || p.y > t->box.br.y) continue;
+
+        if (t->child1 == TREE_NULL) {
+            cb(t->leaf, rock);
+        }
+        else {
+            assert(top + 2 <= TREE_STACK_DEPTH);
+            stack[top++] = t->child1;
+            stack[top++] = t->child2;
+        }
+    }
+}
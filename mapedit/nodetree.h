@@ -0,0 +1,19 @@
+#ifndef MAPEDIT_NODETREE_H
+#define MAPEDIT_NODETREE_H
+
+#include "mapedit/canvas.h"
+#include "mapedit/geometry.h"
+
+typedef void (nodetree_find_cb)(node_id, void *);
+typedef void (nodetree_bounds_cb)(node_id, fpoint *, fpoint *);
+
+void nodetree_reset(void);
+
+void nodetree_build(const node_id *ids, size_t n, nodetree_bounds_cb *bounds);
+void nodetree_insert(node_id id, fpoint tl, fpoint br);
+void nodetree_remove(node_id id);
+void nodetree_update(node_id id, fpoint tl, fpoint br);
+
+void nodetree_find_at(fpoint p, nodetree_find_cb *cb, void *rock);
+
+#endif
@@ -1,76 +1,171 @@
 #include <assert.h>
 #include <stdint.h>
+#include <stdlib.h>
 
 #include "mapedit/canvas.h"
 #include "mapedit/selection.h"
 
-static uint8_t selected_nodes[8192] = {0};
-static uint8_t selected_verts[8192] = {0};
+/* growable bitset with a count of set bits, so "anything selected?" is
+ * O(1) and iteration can skip empty words */
+struct bitset {
+    uint64_t *words;
+    size_t words_alloc;
+    size_t count;
+};
 
-void selection_clear_nodes(void)
+#define BITSET_WORD_BITS (64)
+
+static struct bitset selected_nodes = { NULL, 0, 0 };
+static struct bitset selected_verts = { NULL, 0, 0 };
+
+static void bitset_clear(struct bitset *set)
 {
-    memset(selected_nodes, 0, sizeof selected_nodes);
+    if (set->words)
+        memset(set->words, 0, set->words_alloc * sizeof set->words[0]);
+    set->count = 0;
 }
 
-int selection_has_node(node_id id)
+static void bitset_ensure(struct bitset *set, unsigned id)
 {
-    if (id == ID_ANY) {
-        size_t i;
-        for (i = 0; i < sizeof selected_nodes / sizeof selected_nodes[0]; i++) {
-            if (selected_nodes[i] != 0)
-                return 1;
-        }
-        return 0;
+    size_t want = id / BITSET_WORD_BITS + 1;
+    size_t old_alloc = set->words_alloc;
+
+    if (want <= set->words_alloc) return;
+
+    if (!set->words_alloc) set->words_alloc = 128;
+    while (set->words_alloc < want)
+        set->words_alloc += set->words_alloc;
+
+    set->words = realloc(set->words, set->words_alloc * sizeof set->words[0]);
+    assert(set->words != NULL);
+    memset(&set->words[old_alloc], 0,
+           (set->words_alloc - old_alloc) * sizeof set->words[0]);
+}
+
+static int bitset_has(const struct bitset *set, unsigned id)
+{
+    if (id == ID_ANY) return set->count != 0;
+    if (id / BITSET_WORD_BITS >= set->words_alloc) return 0;
+
+    return (set->words[id / BITSET_WORD_BITS] >> (id % BITSET_WORD_BITS)) & 0x01;
+}
+
+static void bitset_add(struct bitset *set, unsigned id)
+{
+    uint64_t bit = UINT64_C(1) << (id % BITSET_WORD_BITS);
+    uint64_t *word;
+
+    if (id == ID_NONE) return;
+    bitset_ensure(set, id);
+
+    word = &set->words[id / BITSET_WORD_BITS];
+    if (!(*word & bit)) {
+        *word |= bit;
+        set->count ++;
     }
-    return ((selected_nodes[id >> 3] >> (id & 0x07)) & 0x01);
 }
 
-void selection_add_node(node_id id)
+static void bitset_remove(struct bitset *set, unsigned id)
 {
+    uint64_t bit = UINT64_C(1) << (id % BITSET_WORD_BITS);
+    uint64_t *word;
+
     if (id == ID_NONE) return;
-    assert(id <= ID_MAX);
+    if (id / BITSET_WORD_BITS >= set->words_alloc) return;
+
+    word = &set->words[id / BITSET_WORD_BITS];
+    if (*word & bit) {
+        *word &= ~bit;
+        set->count --;
+    }
+}
+
+/* first set bit after prev, or ID_NONE.  pass ID_NONE to start */
+static unsigned bitset_next(const struct bitset *set, unsigned prev)
+{
+    unsigned start = prev + 1; /* n.b. ID_NONE + 1 == 0 */
+    size_t w = start / BITSET_WORD_BITS;
+    uint64_t word;
+
+    if (!set->count || w >= set->words_alloc) return ID_NONE;
+
+    word = set->words[w] & (~UINT64_C(0) << (start % BITSET_WORD_BITS));
+    while (!word) {
+        if (++w >= set->words_alloc) return ID_NONE;
+        word = set->words[w];
+    }
+
+    return w * BITSET_WORD_BITS + __builtin_ctzll(word);
+}
+
+static void bitset_destroy(struct bitset *set)
+{
+    free(set->words);
+    memset(set, 0, sizeof *set);
+}
+
+void selection_destroy(void)
+{
+    bitset_destroy(&selected_nodes);
+    bitset_destroy(&selected_verts);
+}
 
-    selected_nodes[id >> 3] |= 0x01 << (id & 0x07);
+void selection_clear_nodes(void)
+{
+    bitset_clear(&selected_nodes);
+}
+
+int selection_has_node(node_id id)
+{
+    return bitset_has(&selected_nodes, id);
+}
+
+void selection_add_node(node_id id)
+{
+    bitset_add(&selected_nodes, id);
 }
 
 void selection_remove_node(node_id id)
 {
-    if (id == ID_NONE) return;
-    assert(id <= ID_MAX);
+    bitset_remove(&selected_nodes, id);
+}
+
+node_id selection_next_node(node_id prev)
+{
+    return bitset_next(&selected_nodes, prev);
+}
 
-    selected_nodes[id >> 3] &= ~(0x01 << (id & 0x07));
+size_t selection_count_nodes(void)
+{
+    return selected_nodes.count;
 }
 
 void selection_clear_vertices(void)
 {
-    memset(selected_verts, 0, sizeof selected_verts);
+    bitset_clear(&selected_verts);
 }
 
 int selection_has_vertex(vertex_id id)
 {
-    if (id == ID_ANY) {
-        size_t i;
-        for (i = 0; i < sizeof selected_verts / sizeof selected_verts[0]; i++) {
-            if (selected_verts[i] != 0)
-                return 1;
-        }
-        return 0;
-    }
-    return ((selected_verts[id >> 3] >> (id & 0x07)) & 0x01);
+    return bitset_has(&selected_verts, id);
 }
 
 void selection_add_vertex(vertex_id id)
 {
-    if (id == ID_NONE) return;
-    assert(id <= ID_MAX);
-
-    selected_verts[id >> 3] |= 0x01 << (id & 0x07);
+    bitset_add(&selected_verts, id);
 }
 
 void selection_remove_vertex(vertex_id id)
 {
-    if (id == ID_NONE) return;
-    assert(id <= ID_MAX);
+    bitset_remove(&selected_verts, id);
+}
 
-    selected_verts[id >> 3] &= ~(0x01 << (id & 0x07));
+vertex_id selection_next_vertex(vertex_id prev)
+{
+    return bitset_next(&selected_verts, prev);
+}
+
+size_t selection_count_vertices(void)
+{
+    return selected_verts.count;
 }
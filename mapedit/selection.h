@@ -5,14 +5,23 @@
 
 #define ID_ANY (ID_NONE) /* for selection_has_...() */
 
+/* selection_next_...(ID_NONE) returns the first selected id, and
+ * ID_NONE once there are no more */
+
+void selection_destroy(void);
+
 void selection_clear_nodes(void);
 int selection_has_node(node_id id);
 void selection_add_node(node_id id);
 void selection_remove_node(node_id id);
+node_id selection_next_node(node_id prev);
+size_t selection_count_nodes(void);
 
 void selection_clear_vertices(void);
 int selection_has_vertex(vertex_id id);
 void selection_add_vertex(vertex_id id);
 void selection_remove_vertex(vertex_id id);
+vertex_id selection_next_vertex(vertex_id prev);
+size_t selection_count_vertices(void);
 
 #endif
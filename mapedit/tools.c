@@ -45,12 +45,14 @@ static void nodedraw_next_point(fpoint p)
     assert(state->n_points > 0);
 
     if (state->n_points >= 3) {
+        canvas_begin_edit();
         for (i = 0; i < 3; i++) {
             vid[i] = canvas_find_vertex_near(state->points[i], 0, NULL);
             if (vid[i] == ID_NONE)
                 vid[i] = canvas_add_vertex(state->points[i]);
         }
         canvas_add_node(vid[0], vid[1], vid[2]);
+        canvas_end_edit();
         nodedraw_reset();
     }
     else {
@@ -235,6 +237,10 @@ static void vertmove_reset(void)
 {
     struct vertmove_state *state = &vertmove_state;
 
+    /* a move in progress is kept where it is */
+    if (state->selected != ID_NONE)
+        canvas_end_edit();
+
     memset(state, 0, sizeof *state);
     state->selected = ID_NONE;
     state->hovered = ID_NONE;
@@ -295,6 +301,7 @@ static int vertmove_handle_event(const SDL_Event *e)
                                                          scalar_from_screen(TOOL_SNAP),
                                                          NULL);
                 state->selected = ID_NONE;
+                canvas_end_edit();
             }
             break;
         case SDL_KEYDOWN:
@@ -330,13 +337,16 @@ static int vertmove_handle_event(const SDL_Event *e)
 
                 state->selected = state->hovered;
                 state->hovered = ID_NONE;
-                state->orig_point = canvas_vertex(state->selected)->p;
+                state->orig_point = canvas_vertex_point(state->selected);
+                /* everything up to the drop is a single undo step */
+                canvas_begin_edit();
             }
             else {
                 mouse = view_find_gridpoint_near(mouse, scalar_from_screen(TOOL_SNAP));
                 vertmove_edit_vertex(&mouse, NULL);
                 state->hovered = state->selected;
                 state->selected = ID_NONE;
+                canvas_end_edit();
             }
             break;
     }
@@ -350,17 +360,14 @@ static void vertmove_render(SDL_Renderer *renderer)
     SDL_Point a, b;
 
     if (state->selected != ID_NONE) {
-        const struct vertex *vertex = canvas_vertex(state->selected);
-
         a = point_to_screen(state->orig_point);
-        b = point_to_screen(vertex->p);
+        b = point_to_screen(canvas_vertex_point(state->selected));
 
         SDL_SetRenderDrawColor(renderer, C(tool_draw0));
         SDL_RenderDrawLine(renderer, a.x, a.y, b.x, b.y);
     }
     else if (state->hovered != ID_NONE) {
-        const struct vertex *vertex = canvas_vertex(state->hovered);
-        SDL_Point p = point_to_screen(vertex->p);
+        SDL_Point p = point_to_screen(canvas_vertex_point(state->hovered));
 
         filledCircleRGBA(renderer, p.x, p.y, TOOL_SNAP - 1,
                          C(tool_move_high));
@@ -406,7 +413,7 @@ static int nodedel_handle_event(const SDL_Event *e)
 
     switch (e->type) {
         case SDL_MOUSEMOTION:
-            state->over = canvas_find_node_at(mouse);
+            state->over = canvas_find_node_from(mouse, state->over);
             break;
         case SDL_MOUSEBUTTONUP:
             if (e->button.button != SDL_BUTTON_LEFT) break;
@@ -428,9 +435,9 @@ static void nodedel_render(SDL_Renderer *renderer)
     const struct node *node = canvas_node(state->over);
 
     SDL_Point points[3] = {
-        point_to_screen(canvas_vertex(node->v[0])->p),
-        point_to_screen(canvas_vertex(node->v[1])->p),
-        point_to_screen(canvas_vertex(node->v[2])->p),
+        point_to_screen(canvas_vertex_point(node->v[0])),
+        point_to_screen(canvas_vertex_point(node->v[1])),
+        point_to_screen(canvas_vertex_point(node->v[2])),
     };
 
     filledTrigonRGBA(renderer,
@@ -461,7 +468,8 @@ static void arcdraw_sectors_ok(const char *str, void *ctx __attribute__((unused)
     fvector ab, ac;
     int s, n_sectors;
     double r, t, tab, tac;
-    vertex_id a, b, c;
+    fpoint *points;
+    unsigned (*tris)[3];
 
     assert(state->n_points == 3);
 
@@ -480,24 +488,25 @@ static void arcdraw_sectors_ok(const char *str, void *ctx __attribute__((unused)
     if (t <= 0) t += 2 * M_PI;
     t /= n_sectors;
 
-    a = canvas_find_vertex_near(state->points[0], 0, NULL);
-    if (a == ID_NONE)
-        a = canvas_add_vertex(state->points[0]);
-    for (s = 0; s < n_sectors; s++) {
-        fpoint p1, p2;
-        p1.x = state->points[0].x + r * cos(tab + s * t);
-        p1.y = state->points[0].y + r * sin(tab + s * t);
-        b = canvas_find_vertex_near(p1, 0, NULL);
-        if (b == ID_NONE)
-            b = canvas_add_vertex(p1);
-        p2.x = state->points[0].x + r * cos(tab + (s + 1) * t);
-        p2.y = state->points[0].y + r * sin(tab + (s + 1) * t);
-        c = canvas_find_vertex_near(p2, 0, NULL);
-        if (c == ID_NONE)
-            c = canvas_add_vertex(p2);
+    points = malloc((n_sectors + 2) * sizeof points[0]);
+    tris = malloc(n_sectors * sizeof tris[0]);
+    assert(points != NULL && tris != NULL);
 
-        canvas_add_node(a, b, c);
+    points[0] = state->points[0];
+    for (s = 0; s <= n_sectors; s++) {
+        points[s + 1].x = state->points[0].x + r * cos(tab + s * t);
+        points[s + 1].y = state->points[0].y + r * sin(tab + s * t);
     }
+    for (s = 0; s < n_sectors; s++) {
+        tris[s][0] = 0;
+        tris[s][1] = s + 1;
+        tris[s][2] = s + 2;
+    }
+
+    canvas_add_mesh(points, n_sectors + 2, (const unsigned (*)[3]) tris, n_sectors, NULL);
+
+    free(points);
+    free(tris);
 
     arcdraw_reset();
 }
@@ -700,9 +709,14 @@ static void rectdraw_next_point(fpoint p)
 
     if (state->n_points >= 3) {
         const fpoint a = state->points[0], b = state->points[1], p = state->points[2];
+        static const unsigned tris[4][3] = {
+            { 0, 1, 4 },
+            { 1, 2, 4 },
+            { 2, 3, 4 },
+            { 3, 0, 4 },
+        };
         fpoint c, d, e, r;
         fvector rp;
-        vertex_id vert_a, vert_b, vert_c, vert_d, vert_e;
 
         r = addfp(a, projectfv(subtractfp(p, a), subtractfp(b, a)));
         rp = subtractfp(p, r);
@@ -710,25 +724,8 @@ static void rectdraw_next_point(fpoint p)
         d = addfp(a, rp);
         e = addfp(a, scalefv(subtractfp(c, a), 0.5));
 
-        vert_a = canvas_find_vertex_near(a, 0, NULL);
-        if (vert_a == ID_NONE) vert_a = canvas_add_vertex(a);
-
-        vert_b = canvas_find_vertex_near(b, 0, NULL);
-        if (vert_b == ID_NONE) vert_b = canvas_add_vertex(b);
-
-        vert_c = canvas_find_vertex_near(c, 0, NULL);
-        if (vert_c == ID_NONE) vert_c = canvas_add_vertex(c);
-
-        vert_d = canvas_find_vertex_near(d, 0, NULL);
-        if (vert_d == ID_NONE) vert_d = canvas_add_vertex(d);
-
-        vert_e = canvas_find_vertex_near(e, 0, NULL);
-        if (vert_e == ID_NONE) vert_e = canvas_add_vertex(e);
-
-        canvas_add_node(vert_a, vert_b, vert_e);
-        canvas_add_node(vert_b, vert_c, vert_e);
-        canvas_add_node(vert_c, vert_d, vert_e);
-        canvas_add_node(vert_d, vert_a, vert_e);
+        fpoint points[5] = { a, b, c, d, e };
+        canvas_add_mesh(points, 5, tris, 4, NULL);
 
         rectdraw_reset();
     }
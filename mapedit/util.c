@@ -8,6 +8,7 @@
 #include <time.h>
 #include <unistd.h>
 
+#include <sys/mman.h>
 #include <sys/stat.h>
 
 #include "mapedit/util.h"
@@ -101,3 +102,86 @@ FILE *fopen_with_backup(const char *filename)
 
     return file;
 }
+
+/* reads a whole file into a NUL-terminated buffer, which the caller frees.
+ * returns NULL with errno set on failure */
+char *read_file(const char *filename, size_t *size)
+{
+    struct stat stat_buf;
+    char *buf = NULL;
+    size_t len = 0;
+    ssize_t r;
+    int fd, saved_errno;
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0) return NULL;
+
+    if (fstat(fd, &stat_buf) < 0) goto fail;
+
+    buf = malloc(stat_buf.st_size + 1);
+    if (!buf) goto fail;
+
+    while (len < (size_t) stat_buf.st_size) {
+        r = read(fd, buf + len, stat_buf.st_size - len);
+        if (r < 0 && errno == EINTR) continue;
+        if (r < 0) goto fail;
+        if (r == 0) break; /* shrank underneath us */
+        len += r;
+    }
+
+    close(fd);
+    buf[len] = '\0';
+    if (size) *size = len;
+    return buf;
+
+fail:
+    saved_errno = errno;
+    free(buf);
+    close(fd);
+    errno = saved_errno;
+    return NULL;
+}
+
+/* maps a whole file read-only.  returns NULL with errno set on failure,
+ * or for an empty file */
+const void *map_file(const char *filename, size_t *size)
+{
+    struct stat stat_buf;
+    void *data;
+    int fd, saved_errno;
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0) return NULL;
+
+    if (fstat(fd, &stat_buf) < 0) goto fail;
+    if (stat_buf.st_size == 0) {
+        errno = EINVAL;
+        goto fail;
+    }
+
+    data = mmap(NULL, stat_buf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) goto fail;
+
+    close(fd);
+    *size = stat_buf.st_size;
+    return data;
+
+fail:
+    saved_errno = errno;
+    close(fd);
+    errno = saved_errno;
+    return NULL;
+}
+
+void unmap_file(const void *data, size_t size)
+{
+    munmap((void *) data, size);
+}
+
+/* case sensitive, ext includes the dot */
+int has_extension(const char *filename, const char *ext)
+{
+    size_t len = strlen(filename), ext_len = strlen(ext);
+
+    return len > ext_len && !strcmp(filename + len - ext_len, ext);
+}
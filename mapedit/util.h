@@ -4,5 +4,9 @@
 #include <stdio.h>
 
 FILE *fopen_with_backup(const char *filename);
+char *read_file(const char *filename, size_t *size);
+const void *map_file(const char *filename, size_t *size);
+void unmap_file(const void *data, size_t size);
+int has_extension(const char *filename, const char *ext);
 
 #endif
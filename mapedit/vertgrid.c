@@ -0,0 +1,201 @@
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mapedit/canvas.h"
+#include "mapedit/geometry.h"
+#include "mapedit/vertgrid.h"
+
+/* hashed uniform grid over vertex positions.  each vertex lives on an
+ * intrusive doubly-linked chain hanging off the bucket its cell hashes
+ * to, so insert/remove/move are O(1) and a lookup only has to look at
+ * the handful of cells that overlap the query box.
+ */
+
+#define VERTGRID_CELL       (1.0)       /* cell size in canvas units */
+#define VERTGRID_MIN_BUCKETS (1024)     /* power of two */
+#define VERTGRID_CELL_LIMIT (INT32_MAX / 2)
+
+struct vertgrid_entry {
+    int32_t cx;
+    int32_t cy;
+    vertex_id next;
+    vertex_id prev;
+    int in_grid;
+};
+
+static struct vertgrid_entry *entries = NULL;
+static size_t entries_alloc = 0;
+
+static vertex_id *buckets = NULL;
+static size_t buckets_count = 0;
+static size_t grid_count = 0;
+
+static int32_t cell_of(double d)
+{
+    double c = floor(d / VERTGRID_CELL);
+
+    if (c < -VERTGRID_CELL_LIMIT) return -VERTGRID_CELL_LIMIT;
+    if (c > VERTGRID_CELL_LIMIT) return VERTGRID_CELL_LIMIT;
+    return (int32_t) c;
+}
+
+static size_t bucket_of(int32_t cx, int32_t cy)
+{
+    uint32_t h = ((uint32_t) cx * 73856093u) ^ ((uint32_t) cy * 19349663u);
+
+    return h & (buckets_count - 1);
+}
+
+static void entries_ensure(vertex_id id)
+{
+    size_t i, old_alloc = entries_alloc;
+
+    if (id < entries_alloc) return;
+
+    if (!entries_alloc) entries_alloc = VERTGRID_MIN_BUCKETS;
+    while (entries_alloc <= id)
+        entries_alloc += entries_alloc;
+
+    entries = realloc(entries, entries_alloc * sizeof entries[0]);
+    assert(entries != NULL);
+
+    for (i = old_alloc; i < entries_alloc; i++) {
+        memset(&entries[i], 0, sizeof entries[i]);
+        entries[i].next = entries[i].prev = ID_NONE;
+    }
+}
+
+static void chain_link(vertex_id id)
+{
+    struct vertgrid_entry *e = &entries[id];
+    size_t b = bucket_of(e->cx, e->cy);
+
+    e->prev = ID_NONE;
+    e->next = buckets[b];
+    if (e->next != ID_NONE)
+        entries[e->next].prev = id;
+    buckets[b] = id;
+}
+
+static void chain_unlink(vertex_id id)
+{
+    struct vertgrid_entry *e = &entries[id];
+
+    if (e->prev != ID_NONE)
+        entries[e->prev].next = e->next;
+    else
+        buckets[bucket_of(e->cx, e->cy)] = e->next;
+
+    if (e->next != ID_NONE)
+        entries[e->next].prev = e->prev;
+
+    e->next = e->prev = ID_NONE;
+}
+
+static void buckets_resize(size_t n)
+{
+    size_t i;
+
+    free(buckets);
+    buckets = malloc(n * sizeof buckets[0]);
+    assert(buckets != NULL);
+    buckets_count = n;
+
+    for (i = 0; i < buckets_count; i++)
+        buckets[i] = ID_NONE;
+
+    for (i = 0; i < entries_alloc; i++)
+        if (entries[i].in_grid) chain_link(i);
+}
+
+void vertgrid_reset(void)
+{
+    free(entries);
+    entries = NULL;
+    entries_alloc = 0;
+
+    free(buckets);
+    buckets = NULL;
+    buckets_count = 0;
+    grid_count = 0;
+}
+
+void vertgrid_insert(vertex_id id, fpoint p)
+{
+    struct vertgrid_entry *e;
+
+    assert(id != ID_NONE);
+    entries_ensure(id);
+    e = &entries[id];
+    assert(!e->in_grid);
+
+    if (!buckets)
+        buckets_resize(VERTGRID_MIN_BUCKETS);
+    else if (grid_count + 1 > buckets_count)
+        buckets_resize(buckets_count * 2);
+
+    e->cx = cell_of(p.x);
+    e->cy = cell_of(p.y);
+    e->in_grid = 1;
+    chain_link(id);
+    grid_count ++;
+}
+
+void vertgrid_remove(vertex_id id)
+{
+    if (id >= entries_alloc || !entries[id].in_grid) return;
+
+    chain_unlink(id);
+    entries[id].in_grid = 0;
+    grid_count --;
+}
+
+void vertgrid_move(vertex_id id, fpoint p)
+{
+    struct vertgrid_entry *e;
+    int32_t cx = cell_of(p.x), cy = cell_of(p.y);
+
+    assert(id < entries_alloc && entries[id].in_grid);
+    e = &entries[id];
+
+    if (e->cx == cx && e->cy == cy) return;
+
+    chain_unlink(id);
+    e->cx = cx;
+    e->cy = cy;
+    chain_link(id);
+}
+
+/* calls cb for every vertex whose cell overlaps the box.  candidates
+ * still need an exact test, the grid only knows about cells.  returns
+ * -1 without calling cb if the box covers so many cells that a linear
+ * scan would be cheaper */
+int vertgrid_find_within(fpoint tl, fpoint br, canvas_find_vertex_cb *cb, void *rock)
+{
+    const int32_t cx0 = cell_of(tl.x), cy0 = cell_of(tl.y);
+    const int32_t cx1 = cell_of(br.x), cy1 = cell_of(br.y);
+    const double n_cells = ((double) cx1 - cx0 + 1) * ((double) cy1 - cy0 + 1);
+    int32_t cx, cy;
+    vertex_id id;
+    size_t b;
+
+    if (!cb || !grid_count) return 0;
+
+    if (n_cells > buckets_count)
+        return -1;
+
+    for (cy = cy0; cy <= cy1; cy++) {
+        for (cx = cx0; cx <= cx1; cx++) {
+            b = bucket_of(cx, cy);
+            for (id = buckets[b]; id != ID_NONE; id = entries[id].next) {
+                if (entries[id].cx != cx || entries[id].cy != cy) continue;
+                cb(id, rock);
+            }
+        }
+    }
+
+    return 0;
+}
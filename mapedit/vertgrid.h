@@ -0,0 +1,15 @@
+#ifndef MAPEDIT_VERTGRID_H
+#define MAPEDIT_VERTGRID_H
+
+#include "mapedit/canvas.h"
+#include "mapedit/geometry.h"
+
+void vertgrid_reset(void);
+
+void vertgrid_insert(vertex_id id, fpoint p);
+void vertgrid_remove(vertex_id id);
+void vertgrid_move(vertex_id id, fpoint p);
+
+int vertgrid_find_within(fpoint tl, fpoint br, canvas_find_vertex_cb *cb, void *rock);
+
+#endif
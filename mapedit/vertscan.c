@@ -0,0 +1,83 @@
+#include <assert.h>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+#include "mapedit/canvas.h"
+#include "mapedit/geometry.h"
+#include "mapedit/vertscan.h"
+
+void vertscan_within(const float *x, const float *y, size_t n,
+                     fpoint tl, fpoint br,
+                     canvas_find_vertex_cb *cb, void *rock)
+{
+    size_t i = 0;
+
+    if (!cb) return;
+
+#ifdef __SSE__
+    {
+        const __m128 x0 = _mm_set1_ps(tl.x), x1 = _mm_set1_ps(br.x);
+        const __m128 y0 = _mm_set1_ps(tl.y), y1 = _mm_set1_ps(br.y);
+
+        for (; i + 4 <= n; i += 4) {
+            __m128 vx = _mm_loadu_ps(&x[i]);
+            __m128 vy = _mm_loadu_ps(&y[i]);
+            __m128 in = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(vx, x0),
+                                              _mm_cmple_ps(vx, x1)),
+                                   _mm_and_ps(_mm_cmpge_ps(vy, y0),
+                                              _mm_cmple_ps(vy, y1)));
+            int mask = _mm_movemask_ps(in);
+
+            while (mask) {
+                int lane = __builtin_ctz(mask);
+                cb(i + lane, rock);
+                mask &= mask - 1;
+            }
+        }
+    }
+#endif
+
+    for (; i < n; i++) {
+        if (!(x[i] >= tl.x && x[i] <= br.x)) continue;
+        if (!(y[i] >= tl.y && y[i] <= br.y)) continue;
+        cb(i, rock);
+    }
+}
+
+/* lowest id within snap of p, or ID_NONE */
+vertex_id vertscan_near(const float *x, const float *y, size_t n,
+                        fpoint p, double snap)
+{
+    const float snap2 = snap * snap;
+    size_t i = 0;
+
+    assert(snap >= 0);
+
+#ifdef __SSE__
+    {
+        const __m128 px = _mm_set1_ps(p.x), py = _mm_set1_ps(p.y);
+        const __m128 s2 = _mm_set1_ps(snap2);
+
+        for (; i + 4 <= n; i += 4) {
+            __m128 dx = _mm_sub_ps(_mm_loadu_ps(&x[i]), px);
+            __m128 dy = _mm_sub_ps(_mm_loadu_ps(&y[i]), py);
+            __m128 d2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+            int mask = _mm_movemask_ps(_mm_cmple_ps(d2, s2));
+
+            if (mask)
+                return i + __builtin_ctz(mask);
+        }
+    }
+#endif
+
+    for (; i < n; i++) {
+        float dx = x[i] - p.x, dy = y[i] - p.y;
+
+        if (dx * dx + dy * dy <= snap2)
+            return i;
+    }
+
+    return ID_NONE;
+}
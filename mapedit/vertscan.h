@@ -0,0 +1,18 @@
+#ifndef MAPEDIT_VERTSCAN_H
+#define MAPEDIT_VERTSCAN_H
+
+#include "mapedit/canvas.h"
+#include "mapedit/geometry.h"
+
+/* linear scans over separate x[] and y[] coordinate arrays.  entries
+ * with NaN coordinates never match, which is how tombstones are kept
+ * out without a separate liveness test */
+
+void vertscan_within(const float *x, const float *y, size_t n,
+                     fpoint tl, fpoint br,
+                     canvas_find_vertex_cb *cb, void *rock);
+
+vertex_id vertscan_near(const float *x, const float *y, size_t n,
+                        fpoint p, double snap);
+
+#endif
@@ -33,6 +33,8 @@ static struct {
 } view;
 
 extern struct vertex *verts;
+extern float *verts_x;
+extern float *verts_y;
 extern size_t verts_alloc;
 extern size_t verts_count;
 extern struct node *nodes;
@@ -255,9 +257,9 @@ void view_render(SDL_Renderer *renderer)
             if (n->id == ID_NONE) continue;
 
             SDL_Point points[3] = {
-                point_to_screen(verts[n->v[0]].p),
-                point_to_screen(verts[n->v[1]].p),
-                point_to_screen(verts[n->v[2]].p),
+                pointxy_to_screen(verts_x[n->v[0]], verts_y[n->v[0]]),
+                pointxy_to_screen(verts_x[n->v[1]], verts_y[n->v[1]]),
+                pointxy_to_screen(verts_x[n->v[2]], verts_y[n->v[2]]),
             };
 
             filledTrigonRGBA(renderer,
@@ -272,14 +274,15 @@ void view_render(SDL_Renderer *renderer)
                        C(view_edge));
         }
 
-        for (i = 0; i < verts_count; i++) {
-            const struct vertex *v = &verts[i];
+        for (i = selection_next_vertex(ID_NONE);
+             i != ID_NONE;
+             i = selection_next_vertex(i)) {
             SDL_Point p;
 
-            if (v->id == ID_NONE) continue;
-            if (!selection_has_vertex(v->id)) continue;
+            if (i >= verts_count) break;
+            if (verts[i].id == ID_NONE) continue;
 
-            p = point_to_screen(v->p);
+            p = pointxy_to_screen(verts_x[i], verts_y[i]);
             filledCircleRGBA(renderer, p.x, p.y, 1, C(view_selected));
         }
 